@@ -78,6 +78,55 @@
 #define FoxPro2WM 0xF5
 /*! \def VisualFoxPro Code for Visual FoxPro without memo fields */
 #define VisualFoxPro 0x30
+/*! \def VisualFoxProAI Code for Visual FoxPro with autoincrement fields */
+#define VisualFoxProAI 0x31
+/*! \def VisualFoxProVar Code for Visual FoxPro with varchar or varbinary fields */
+#define VisualFoxProVar 0x32
+
+/*! \def DBF_FIELD_SYSTEM Visual FoxPro field flag of hidden system fields */
+#define DBF_FIELD_SYSTEM 0x01
+/*! \def DBF_FIELD_NULLABLE Visual FoxPro field flag of fields which can be null */
+#define DBF_FIELD_NULLABLE 0x02
+/*! \def DBF_FIELD_BINARY Visual FoxPro field flag of fields not using the codepage */
+#define DBF_FIELD_BINARY 0x04
+
+/*! \def DBF_OPEN_RDWR Open flag to allow modifying the file */
+#define DBF_OPEN_RDWR 0x01
+/*! \def DBF_OPEN_CHECKSIZE Open flag to reject files shorter than stated by the header */
+#define DBF_OPEN_CHECKSIZE 0x02
+/*! \def DBF_OPEN_SHARED Open flag to share the file with other processes by byte range locks */
+#define DBF_OPEN_SHARED 0x04
+
+/*! \def DBF_PACK_INPLACE Pack records within the file itself */
+#define DBF_PACK_INPLACE 0
+/*! \def DBF_PACK_TEMPFILE Pack records into a temporary file replacing the file */
+#define DBF_PACK_TEMPFILE 1
+
+/*! \def DBF_ACCESS_NORMAL Access hint to restore the default readahead */
+#define DBF_ACCESS_NORMAL 0
+/*! \def DBF_ACCESS_SEQUENTIAL Access hint for reading the records in order */
+#define DBF_ACCESS_SEQUENTIAL 1
+/*! \def DBF_ACCESS_RANDOM Access hint for reading records in random order */
+#define DBF_ACCESS_RANDOM 2
+/*! \def DBF_ACCESS_WILLNEED Access hint to read all records in the background */
+#define DBF_ACCESS_WILLNEED 3
+
+/*! \def DBF_SKIP_DELETED Scan option to skip deleted records */
+#define DBF_SKIP_DELETED 0x01
+
+/*! \def DBF_SAMPLE_STRATIFIED Sample flag to take one record from each of equal parts of the table */
+#define DBF_SAMPLE_STRATIFIED 0x01
+
+/*! \def DBF_SORT_DESC Sort flag to sort in descending order */
+#define DBF_SORT_DESC 0x01
+
+/*! \def DBF_STATS_BINS Number of bins of the histograms in \ref DBF_STATS */
+#define DBF_STATS_BINS 16
+
+/*! \def DBF_CSV_HEADER Export flag to write the column names first */
+#define DBF_CSV_HEADER 0x01
+/*! \def DBF_CSV_UTF8 Export flag to convert character fields into UTF-8 */
+#define DBF_CSV_UTF8 0x02
 
 /*! \brief Object handle for dBASE file
 
@@ -92,8 +141,132 @@ typedef struct _P_DBF P_DBF;
 	\ref dbf_CreateFH.
 */
 typedef struct _DB_FIELD DB_FIELD;
+
+/*! \brief Object handle for a set of dBASE files with the same fields
+
+  A pointer of type DBF_SET is returned by \ref dbf_OpenSet.
+*/
+typedef struct _DBF_SET DBF_SET;
+
+/*! \brief Callback of \ref dbf_ScanSet
+
+  Called with the number of the file within the set, the number of the
+	record within the file counted from 0, the raw record and the number
+	of the worker calling it. Returns 0 to go on and any other value to
+	stop the scan.
+*/
+typedef int (*DBF_SCAN)(void *ctx, int file, u_int32_t recno, const char *record, int worker);
+
+/*! \brief Callback of \ref dbf_HashJoin
+
+  Called with the numbers of the records counted from 0 and the raw
+	records of a pair from the build and the probe table, and the number
+	of the worker calling it. The records are only valid during the call.
+	Returns 0 to go on and any other value to stop the join.
+*/
+typedef int (*DBF_JOIN)(void *ctx, u_int32_t buildrec, const char *build, u_int32_t proberec, const char *probe, int worker);
+
+/*! \brief Callback of \ref dbf_Follow
+
+  Called with the number of the first record counted from 0, the raw
+	records, one after the other, and the number of records. Returns 0 to
+	go on and any other value to stop.
+*/
+typedef int (*DBF_FOLLOW)(void *ctx, u_int32_t first, const char *records, int n);
 #define SIZE_OF_DB_FIELD 32
 
+/*! \def DBF_VALUE_NULL Value type of blank and null fields */
+#define DBF_VALUE_NULL 0
+/*! \def DBF_VALUE_STRING Value type of character, memo and unknown fields */
+#define DBF_VALUE_STRING 1
+/*! \def DBF_VALUE_INT Value type of integer and numeric fields without decimals */
+#define DBF_VALUE_INT 2
+/*! \def DBF_VALUE_DOUBLE Value type of numeric, float and double fields */
+#define DBF_VALUE_DOUBLE 3
+/*! \def DBF_VALUE_DATE Value type of date fields */
+#define DBF_VALUE_DATE 4
+/*! \def DBF_VALUE_BOOL Value type of logical fields */
+#define DBF_VALUE_BOOL 5
+/*! \def DBF_VALUE_DATETIME Value type of datetime fields */
+#define DBF_VALUE_DATETIME 6
+/*! \def DBF_VALUE_CURRENCY Value type of currency fields */
+#define DBF_VALUE_CURRENCY 7
+
+/*! \brief Decoded value of one field
+
+  An array of DBF_VALUE with one element per column is filled by
+	\ref dbf_DecodeRecord.
+*/
+typedef struct {
+	/*! one of the DBF_VALUE_* types */
+	int type;
+	union {
+		/*! DBF_VALUE_STRING: the field within the record without trailing
+			blanks, not 0-terminated */
+		struct {
+			const char *data;
+			int len;
+		} str;
+		/*! DBF_VALUE_INT, DBF_VALUE_CURRENCY in units of 1/10000 and
+			DBF_VALUE_DATETIME in milliseconds since 1970-01-01 */
+		int64_t i;
+		/*! DBF_VALUE_DOUBLE */
+		double d;
+		/*! DBF_VALUE_DATE in days since 1970-01-01 and DBF_VALUE_BOOL */
+		int32_t days;
+		/*! DBF_VALUE_BOOL, 1 for true and 0 for false */
+		int b;
+	} v;
+} DBF_VALUE;
+
+/*! \brief Aggregates of a column within one group of records
+
+  An array of DBF_AGGREGATE is returned by \ref dbf_Aggregate.
+*/
+typedef struct {
+	/*! value of the grouping column without trailing blanks, 0-terminated */
+	const char *key;
+	/*! length of the key */
+	int keylen;
+	/*! number of records in the group */
+	long records;
+	/*! number of records with a value in the column, not blank or null */
+	long count;
+	/*! sum of the values */
+	double sum;
+	/*! exact sum of integer, date, datetime and logical columns and of
+	 currencies in units of 1/10000, 0 for floating point columns and if
+	 the sum does not fit into 64 bits */
+	int64_t isum;
+	/*! smallest value, 0 if count is 0 */
+	double min;
+	/*! largest value, 0 if count is 0 */
+	double max;
+} DBF_AGGREGATE;
+
+/*! \brief Statistics of a column estimated from a sample
+
+  An array of DBF_STATS with one element per column is filled by
+	\ref dbf_Sample.
+*/
+typedef struct {
+	/*! number of records sampled */
+	long sampled;
+	/*! number of blank or null fields in the sample */
+	long blanks;
+	/*! number of fields in the sample holding a finite number, date or logical */
+	long numeric;
+	/*! estimated number of distinct values in the sample, at most sampled,
+	  not scaled to the table */
+	double distinct;
+	/*! smallest number in the sample */
+	double min;
+	/*! largest number in the sample */
+	double max;
+	/*! number of values in each of DBF_STATS_BINS equal ranges from min to max */
+	long histogram[DBF_STATS_BINS];
+} DBF_STATS;
+
 /*
  *	FUNCTIONS
  */
@@ -118,11 +291,49 @@ int dbf_GetVersion(P_DBF *p_dbf);
 
 	Opens a dBASE file and returns the object handle.
 	Additional information from the dBASE header are read and stored
-	internally.
+	internally. Files whose header has no fields or whose fields do not
+	fit into the record length are rejected.
 	\return NULL in case of an error.
 */
 P_DBF *dbf_Open (const char *file);
 
+/*! \fn P_DBF *dbf_OpenEx (const char *file, int flags)
+	\brief dbf_OpenEx opens a dBASE \a file with additional flags
+	\param file the filename of the dBASE file
+	\param flags the open flags or'ed together
+
+	Works like \ref dbf_Open but takes additional \a flags.
+	\ref DBF_OPEN_RDWR opens the file for reading and writing, which is
+	needed e.g. by \ref dbf_Pack.
+	\ref DBF_OPEN_CHECKSIZE compares the size of the file with the size
+	of the header and all records and fails if the file is truncated.
+	Only the header is read for this check, see \ref dbf_Verify for a
+	complete check.
+	\ref DBF_OPEN_SHARED lets one process append records by
+	\ref dbf_WriteRecord while other processes read the file, see
+	\ref dbf_Refresh.
+	The filename "-" reads the table from stdin. Pipes are read once from
+	the beginning to the end by one thread, so every record can be read
+	only once and functions like \ref dbf_Verify, which read the file
+	again, fail.
+	\return NULL in case of an error.
+*/
+P_DBF *dbf_OpenEx (const char *file, int flags);
+
+/*! \fn P_DBF *dbf_OpenMemory (const void *buf, size_t len)
+	\brief dbf_OpenMemory opens a dBASE file held in memory
+	\param buf the complete content of the dBASE file
+	\param len the size of \a buf in bytes
+
+	Opens a dBASE file which has already been read into memory, e.g.
+	received over the network, and returns the object handle.
+	The buffer is neither copied nor freed by libdbf and must stay valid
+	until \ref dbf_Close is called. Records can be accessed without
+	copying them by \ref dbf_ReadRecordPtr.
+	\return NULL in case of an error.
+*/
+P_DBF *dbf_OpenMemory (const void *buf, size_t len);
+
 /*! \fn P_DBF *dbf_CreateFH (int fh, DB_FIELD *fields, int numfields)
 	\brief dbf_Create opens a new dBASE \a file and returns the object handle
 	\param fh file handle of already open file
@@ -145,6 +356,19 @@ P_DBF *dbf_CreateFH (int fh, DB_FIELD *fields, int numfields);
 */
 P_DBF *dbf_Create (const char *file, DB_FIELD *fields, int numfields);
 
+/*! \fn P_DBF *dbf_CreateMemory (DB_FIELD *fields, int numfields)
+	\brief dbf_CreateMemory creates a new dBASE file in memory
+	\param fields record of field specification
+	\param numfields number of fields
+
+	Creates a dBASE file in a memory buffer and returns the object handle.
+	The buffer grows as records are added by \ref dbf_WriteRecord. Unlike
+	for files the header is only written once, when the table is closed by
+	\ref dbf_CloseMemory, which also hands the buffer to the caller.
+	\return NULL in case of an error.
+*/
+P_DBF *dbf_CreateMemory (DB_FIELD *fields, int numfields);
+
 /*! \fn int dbf_Close (P_DBF *p_dbf)
 	\brief dbf_Close closes a dBASE file.
 	\param *p_dbf the object handle of the opened file
@@ -154,13 +378,27 @@ P_DBF *dbf_Create (const char *file, DB_FIELD *fields, int numfields);
 */
 int dbf_Close (P_DBF *p_dbf);
 
+/*! \fn int dbf_CloseMemory (P_DBF *p_dbf, void **buf, size_t *len)
+	\brief dbf_CloseMemory closes a dBASE file created in memory
+	\param *p_dbf the object handle returned by \ref dbf_CreateMemory
+	\param buf returns the buffer holding the complete dBASE file
+	\param len returns the size of the buffer in bytes
+
+	Writes the final header, closes the table and frees all memory
+	except for the buffer, which is returned in \a buf and must be
+	released by the caller with free(). If \a buf is NULL the buffer is
+	freed as well.
+	\return 0 if closing was successful and -1 if not.
+*/
+int dbf_CloseMemory (P_DBF *p_dbf, void **buf, size_t *len);
+
 // Functions to info about rows and columns
 /*! \fn int dbf_NumRows (P_DBF *p_dbf)
 	\brief dbf_NumRows returns the number of datasets/rows
 	\param *p_dbf the object handle of the opened file
 
 	Returns the number of datasets/rows.
-	\return Number of rows or -1 in case of an error.
+	\return Number of rows, 0 for an empty table.
 */
 int dbf_NumRows (P_DBF *p_dbf);
 
@@ -299,6 +537,18 @@ int dbf_HeaderSize(P_DBF *p_dbf);
 */
 int dbf_SetRecordOffset(P_DBF *p_dbf, int offset);
 
+/*! \fn int dbf_SetScanOptions(P_DBF *p_dbf, int options)
+	\brief dbf_SetScanOptions sets options for reading records
+	\param *p_dbf the object handle of the opened file
+	\param options the options or'ed together
+
+	Sets the options used by \ref dbf_ReadRecord and \ref dbf_ReadRecordPtr.
+	If \ref DBF_SKIP_DELETED is set, deleted records are skipped silently.
+
+	\return the previously set options
+*/
+int dbf_SetScanOptions(P_DBF *p_dbf, int options);
+
 /*! \fn int dbf_ReadRecord(P_DBF *p_dbf, char *record, int len)
 	\brief dbf_ReadRecord reads the current record
 	\param *p_dbf the object handle of the opened file
@@ -312,6 +562,135 @@ int dbf_SetRecordOffset(P_DBF *p_dbf, int offset);
 */
 int dbf_ReadRecord(P_DBF *p_dbf, char *record, int len);
 
+/*! \fn const char *dbf_ReadRecordPtr(P_DBF *p_dbf)
+	\brief dbf_ReadRecordPtr returns the current record without copying it
+	\param *p_dbf the object handle of a table opened by \ref dbf_OpenMemory
+
+	Returns a pointer to the current record within the buffer passed
+	to \ref dbf_OpenMemory and advances the internal record counter like
+	\ref dbf_ReadRecord does. The record has a length of
+	\ref dbf_RecordLength bytes and must not be modified.
+
+	\return pointer to the record, NULL at the end of the table or if the
+	table is not held in memory
+*/
+const char *dbf_ReadRecordPtr(P_DBF *p_dbf);
+
+/*! \fn int dbf_IsDeleted(P_DBF *p_dbf, const char *record)
+	\brief dbf_IsDeleted tells if a record is marked as deleted
+	\param *p_dbf the object handle of the opened file
+	\param *record a record as returned by \ref dbf_ReadRecord
+
+	\return 1 if the record is deleted, 0 if not
+*/
+int dbf_IsDeleted(P_DBF *p_dbf, const char *record);
+
+/*! \fn int dbf_GetLiveBitmap(P_DBF *p_dbf, unsigned char *bitmap)
+	\brief dbf_GetLiveBitmap marks all records which are not deleted
+	\param *p_dbf the object handle of the opened file
+	\param *bitmap memory of at least (\ref dbf_NumRows + 7) / 8 bytes
+
+	Scans the deletion flags of all records in one pass and sets bit
+	(n % 8) of byte n / 8 in \a bitmap if record n, counted from 0,
+	is not deleted. The internal record counter is not changed.
+	Use \ref dbf_BitmapNext to iterate over the live records.
+
+	\return number of records not deleted, -1 on error
+*/
+int dbf_GetLiveBitmap(P_DBF *p_dbf, unsigned char *bitmap);
+
+/*! \fn int dbf_BitmapNext(const unsigned char *bitmap, int nrecords, int recno)
+	\brief dbf_BitmapNext finds the next live record in a bitmap
+	\param *bitmap bitmap filled by \ref dbf_GetLiveBitmap
+	\param nrecords the number of records in the bitmap
+	\param recno the record, counted from 0, to start searching at
+
+	\return the number of the next live record counted from 0 or -1 if
+	there are none left
+*/
+int dbf_BitmapNext(const unsigned char *bitmap, int nrecords, int recno);
+
+/*! \fn int dbf_IsNull(P_DBF *p_dbf, const char *record, int column)
+	\brief dbf_IsNull tells if a field of a record is null
+	\param *p_dbf the object handle of the opened file
+	\param *record a record as returned by \ref dbf_ReadRecord
+	\param column the number of the column
+
+	Only Visual FoxPro tables can store null values. They mark them in
+	the hidden _NullFlags field for columns having \ref DBF_FIELD_NULLABLE
+	set. For all other tables and columns fields are never null.
+
+	\return 1 if the field is null, 0 if not, -1 on error
+*/
+int dbf_IsNull(P_DBF *p_dbf, const char *record, int column);
+
+/*! \fn int dbf_GetInt64(P_DBF *p_dbf, const char *record, int column, int64_t *value)
+	\brief dbf_GetInt64 reads a field as integer
+	\param *p_dbf the object handle of the opened file
+	\param *record a record as returned by \ref dbf_ReadRecord
+	\param column the number of a numeric, float, integer or currency column
+	\param *value the integer, decimals are cut off
+
+	The binary integer and currency fields of Visual FoxPro are loaded
+	directly, numeric and float fields are parsed.
+
+	\return 0 on success, 1 if the field is blank or null, -1 on error
+*/
+int dbf_GetInt64(P_DBF *p_dbf, const char *record, int column, int64_t *value);
+
+/*! \fn int dbf_GetDouble(P_DBF *p_dbf, const char *record, int column, double *value)
+	\brief dbf_GetDouble reads a field as floating point number
+	\param *p_dbf the object handle of the opened file
+	\param *record a record as returned by \ref dbf_ReadRecord
+	\param column the number of a numeric, float, double, integer or
+	currency column
+	\param *value the number
+
+	\return 0 on success, 1 if the field is blank or null, -1 on error
+*/
+int dbf_GetDouble(P_DBF *p_dbf, const char *record, int column, double *value);
+
+/*! \fn int dbf_GetCurrency(P_DBF *p_dbf, const char *record, int column, int64_t *value)
+	\brief dbf_GetCurrency reads a field as fixed point number
+	\param *p_dbf the object handle of the opened file
+	\param *record a record as returned by \ref dbf_ReadRecord
+	\param column the number of a currency, integer, numeric or float column
+	\param *value the number in units of 1/10000, the precision of the
+	currency fields of Visual FoxPro
+
+	\return 0 on success, 1 if the field is blank or null, -1 on error
+*/
+int dbf_GetCurrency(P_DBF *p_dbf, const char *record, int column, int64_t *value);
+
+/*! \fn int dbf_GetDateTime(P_DBF *p_dbf, const char *record, int column, int64_t *msec)
+	\brief dbf_GetDateTime reads a date or datetime field
+	\param *p_dbf the object handle of the opened file
+	\param *record a record as returned by \ref dbf_ReadRecord
+	\param column the number of a date or datetime column
+	\param *msec the milliseconds since 1970-01-01 00:00
+
+	\return 0 on success, 1 if the field is blank or null, -1 on error
+*/
+int dbf_GetDateTime(P_DBF *p_dbf, const char *record, int column, int64_t *msec);
+
+/*! \fn int dbf_DecodeRecord(P_DBF *p_dbf, const char *record, DBF_VALUE *values)
+	\brief dbf_DecodeRecord decodes all fields of a record
+	\param *p_dbf the object handle of the opened file
+	\param *record a record as returned by \ref dbf_ReadRecord
+	\param *values memory for \ref dbf_NumCols values
+
+	Decodes the fields of all columns into typed values. The decoder of
+	each column is chosen once when the table is opened, so decoding
+	a record does not check the field types again. Fields which cannot
+	be parsed are returned as DBF_VALUE_STRING. The memo, general and
+	picture fields of Visual FoxPro are returned as DBF_VALUE_INT block
+	numbers. Strings point into \a record and are valid as long as the
+	record is.
+
+	\return the number of values or -1 on error
+*/
+int dbf_DecodeRecord(P_DBF *p_dbf, const char *record, DBF_VALUE *values);
+
 /*! \fn int dbf_WriteRecord(P_DBF *p_dbf, char *record, int len)
 	\brief dbf_WriteRecord writes a record
 	\param *p_dbf the object handle of the opened file
@@ -327,6 +706,56 @@ int dbf_ReadRecord(P_DBF *p_dbf, char *record, int len);
 */
 int dbf_WriteRecord(P_DBF *p_dbf, char *record, int len);
 
+/*! \fn int dbf_UpdateRecord(P_DBF *p_dbf, int recno, int column, const char *value)
+	\brief dbf_UpdateRecord modifies one field of an existing record
+	\param *p_dbf the object handle of a file opened with \ref DBF_OPEN_RDWR
+	\param recno the number of the record as returned by \ref dbf_ReadRecord
+	\param column the number of the column
+	\param *value the new value of the field
+
+	Sets a field of the record with number \a recno, counted from 0.
+	Values shorter than the field are padded with blanks, numbers ('N' and
+	'F') are aligned right, all other values left. Longer values are
+	truncated, except for numbers, which are rejected. The binary fields
+	of Visual FoxPro cannot be set as text, use the setters like
+	\ref dbf_PutInt64 and \ref dbf_UpdateRecordData for them. A null
+	field is no longer null once it is set. The modification is kept in memory until
+	\ref dbf_Flush or \ref dbf_Close is called, but is visible to
+	\ref dbf_ReadRecord immediately.
+
+	\return 0 if successful, -1 on error or if a number does not fit into
+	the field
+*/
+int dbf_UpdateRecord(P_DBF *p_dbf, int recno, int column, const char *value);
+
+/*! \fn int dbf_UpdateRecordData(P_DBF *p_dbf, int recno, const char *record, int len)
+	\brief dbf_UpdateRecordData replaces all fields of an existing record
+	\param *p_dbf the object handle of a file opened with \ref DBF_OPEN_RDWR
+	\param recno the number of the record as returned by \ref dbf_ReadRecord
+	\param *record record data suitable for writing into the dBASE file
+	\param len the length of the record block
+
+	Like \ref dbf_WriteRecord the record data must not contain the
+	leading byte which indicates whether the record is deleted, hence
+	len must be \ref dbf_RecordLength() - 1. The deletion flag is not
+	changed. See \ref dbf_UpdateRecord for when the data is written.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_UpdateRecordData(P_DBF *p_dbf, int recno, const char *record, int len);
+
+/*! \fn int dbf_Flush(P_DBF *p_dbf)
+	\brief dbf_Flush writes modified records into the file
+	\param *p_dbf the object handle of the opened file
+
+	Writes all records modified by \ref dbf_UpdateRecord and
+	\ref dbf_UpdateRecordData into the file. Modifications of records
+	which are adjacent in the file are written at once.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_Flush(P_DBF *p_dbf);
+
 /*! \fn int dbf_IsMemo(P_DBF *p_dbf)
 	\brief dbf_IsMemo tells if dbf provides also a memo file
 	\param *p_dbf the object handle of the opened file
@@ -337,3 +766,577 @@ int dbf_WriteRecord(P_DBF *p_dbf, char *record, int len);
 */
 int dbf_IsMemo(P_DBF *p_dbf);
 
+/*! \fn int dbf_Pack(P_DBF *p_dbf, int mode, int64_t *reclaimed)
+	\brief dbf_Pack removes all deleted records from a dBASE file
+	\param *p_dbf the object handle of a file opened with \ref DBF_OPEN_RDWR
+	\param mode \ref DBF_PACK_INPLACE or \ref DBF_PACK_TEMPFILE
+	\param *reclaimed returns the number of bytes the file has shrunk, may be NULL
+
+	Moves all records which are not deleted towards the beginning of
+	the file, updates the number of records and truncates the file.
+	Records are read and written in large blocks.
+	With \ref DBF_PACK_INPLACE the records are moved within the file and
+	the transaction flag of the header is set until the pack has
+	finished, so an interrupted pack can be detected.
+	With \ref DBF_PACK_TEMPFILE the records are written into a temporary
+	file which replaces the original file only after it has been
+	completely written. The internal record counter is reset.
+
+	\return 0 if successful, -1 on error
+*/
+int dbf_Pack(P_DBF *p_dbf, int mode, int64_t *reclaimed);
+
+/*! \fn int dbf_GetCodepage(P_DBF *p_dbf)
+	\brief dbf_GetCodepage returns the codepage of the dBASE file
+	\param *p_dbf the object handle of the opened file
+
+	Returns the codepage set by \ref dbf_SetCodepage or, if none was set,
+	the codepage given by the language driver ID of the header, e.g.
+	437, 850 or 1252.
+
+	\return codepage or 0 if it is unknown
+*/
+int dbf_GetCodepage(P_DBF *p_dbf);
+
+/*! \fn int dbf_SetCodepage(P_DBF *p_dbf, int codepage)
+	\brief dbf_SetCodepage sets the codepage of the dBASE file
+	\param *p_dbf the object handle of the opened file
+	\param codepage the codepage or 0 to use the language driver ID
+
+	Sets the codepage used by \ref dbf_ToUTF8, for files whose header
+	does not contain a language driver ID or contains a wrong one.
+	Supported are the single byte DOS, Windows and Mac codepages
+	437, 737, 850, 852, 857, 860, 861, 863, 865, 866, 874, 1250, 1251,
+	1252, 1253, 1254, 1257, 10000, 10006, 10007 and 10029.
+
+	\return 0 if successful, -1 if the codepage is not supported
+*/
+int dbf_SetCodepage(P_DBF *p_dbf, int codepage);
+
+/*! \fn int dbf_ToUTF8(P_DBF *p_dbf, const char *src, int len, char *dst)
+	\brief dbf_ToUTF8 converts field data into UTF-8
+	\param *p_dbf the object handle of the opened file
+	\param *src the data to convert
+	\param len the number of bytes to convert
+	\param *dst memory of at least 3 * \a len bytes
+
+	Converts \a len bytes from the codepage of the dBASE file, see
+	\ref dbf_GetCodepage, into UTF-8. The result is not 0-terminated.
+
+	\return the number of bytes stored in \a dst or -1 if the codepage
+	is unknown or not supported
+*/
+int dbf_ToUTF8(P_DBF *p_dbf, const char *src, int len, char *dst);
+
+/*! \fn int dbf_ColumnToUTF8(P_DBF *p_dbf, const char *records, int nrecords, int column, char *dst, int *offsets)
+	\brief dbf_ColumnToUTF8 converts a column of many records into UTF-8
+	\param *p_dbf the object handle of the opened file
+	\param *records \a nrecords consecutive records as stored in the file
+	\param nrecords the number of records
+	\param column the number of the column
+	\param *dst memory of at least 3 * \a nrecords * \ref dbf_ColumnSize bytes
+	\param *offsets memory for \a nrecords + 1 offsets
+
+	Converts the field \a column of all records like \ref dbf_ToUTF8.
+	The converted field of record i starts at \a dst + \a offsets[i] and
+	ends at \a dst + \a offsets[i+1].
+
+	\return the number of bytes stored in \a dst or -1 on error
+*/
+int dbf_ColumnToUTF8(P_DBF *p_dbf, const char *records, int nrecords, int column, char *dst, int *offsets);
+
+/*! \fn long dbf_ExportCSV(P_DBF *p_dbf, int fd, char delimiter, int flags, int threads)
+	\brief dbf_ExportCSV writes all records as comma separated values
+	\param *p_dbf the object handle of the opened file
+	\param fd the file descriptor to write to
+	\param delimiter the character separating fields, usually ','
+	\param flags \ref DBF_CSV_HEADER and \ref DBF_CSV_UTF8 or'ed together
+	\param threads the number of threads, 0 for one per processor
+
+	Writes one line per record into \a fd. Leading and trailing blanks of
+	the fields are removed. The binary fields of Visual FoxPro are
+	written as numbers, datetimes as YYYY-MM-DD HH:MM:SS, null fields are
+	left empty and _NullFlags is left out. Fields containing the delimiter, quotes or line
+	breaks are quoted, lines end with CR LF as required by RFC 4180.
+	With \ref DBF_CSV_UTF8 character fields are converted from the
+	codepage of the file, see \ref dbf_ToUTF8. Deleted records are skipped
+	if \ref DBF_SKIP_DELETED is set by \ref dbf_SetScanOptions.
+	The records are formatted in chunks by several threads and written in
+	their original order. The internal record counter is not changed.
+
+	\return the number of records written or -1 on error
+*/
+long dbf_ExportCSV(P_DBF *p_dbf, int fd, char delimiter, int flags, int threads);
+
+/*! \fn long dbf_ExportArrow(P_DBF *p_dbf, int fd, int batchsize)
+	\brief dbf_ExportArrow writes all records as Apache Arrow IPC stream
+	\param *p_dbf the object handle of the opened file
+	\param fd the file descriptor to write to
+	\param batchsize the number of records per record batch, 0 for 65536
+	or fewer records of together about 64 MB
+
+	Writes the schema and the records in batches of \a batchsize records
+	in the Arrow IPC streaming format, which is read by pyarrow, DuckDB,
+	Polars and others and converted to Parquet by their tools.
+	Character fields become utf8 columns if the codepage of the file is
+	known, see \ref dbf_ToUTF8, and binary columns otherwise. Numeric
+	fields without decimals become int64 columns, other numeric and float
+	fields float64 columns, dates date32 and logical fields bool columns.
+	The integer, double, datetime and currency fields of Visual FoxPro
+	become int32, float64, timestamp and decimal128 columns, its memo
+	block numbers int32 columns. Fields of other types and binary fields
+	of unexpected widths become binary columns. Blank fields are stored as null. Deleted records are skipped if
+	\ref DBF_SKIP_DELETED is set by \ref dbf_SetScanOptions.
+	The internal record counter is not changed.
+
+	\return the number of records written or -1 on error
+*/
+long dbf_ExportArrow(P_DBF *p_dbf, int fd, int batchsize);
+
+/*! \fn DBF_AGGREGATE *dbf_Aggregate(P_DBF *p_dbf, int column, int groupby, int *ngroups, int threads)
+	\brief dbf_Aggregate computes count, sum, minimum and maximum of a column
+	\param *p_dbf the object handle of the opened file
+	\param column the number of a numeric, float, date, logical or Visual
+	FoxPro binary column
+	\param groupby the number of a character column to group the records
+	by or -1 to aggregate all records
+	\param *ngroups the number of groups returned
+	\param threads the number of threads, 0 for one per processor
+
+	Scans the records in chunks by several threads and decodes the
+	field directly within the records read. Dates are counted in days
+	and datetimes in milliseconds since 1970-01-01, logical fields as
+	1 for true and 0 for false, so their sum is the number of true
+	values. Integers, currencies, dates, datetimes and logical fields are
+	summed up exactly in isum, whose value sum shows as floating point
+	number, so their sums do not depend on the threads, unless they
+	exceed 64 bits. Blank and null
+	fields are left out of count, sum, min and max.
+	Deleted records are skipped if \ref DBF_SKIP_DELETED is set by
+	\ref dbf_SetScanOptions. Grouping is meant for columns with few
+	distinct values, the groups are sorted by their keys. Without
+	grouping exactly one result is returned.
+	The internal record counter is not changed.
+
+	\return array of \a ngroups results, which is released with a single
+	call of free(), or NULL on error
+*/
+DBF_AGGREGATE *dbf_Aggregate(P_DBF *p_dbf, int column, int groupby, int *ngroups, int threads);
+
+/*! \fn int dbf_Verify(P_DBF *p_dbf, u_int32_t *checksum, int threads)
+	\brief dbf_Verify checks a table for truncation and damage
+	\param *p_dbf the object handle of the opened file
+	\param *checksum the checksum of the table, may be NULL
+	\param threads the number of threads, 0 for one per processor
+
+	Compares the size of the file with the size of the header and all
+	records, which may be followed by the end of file marker. Truncated
+	files are rejected at once. Otherwise the table is read in large
+	chunks by several threads, which check that every record starts
+	with a valid deletion flag and compute a CRC32C checksum of each
+	chunk. \a checksum is the CRC32C of the checksums of all chunks and
+	can be compared with the checksum of another copy of the table.
+	Files which are not regular files, like pipes, cannot be checked.
+
+	\return 0 if the table is intact, 1 if it is damaged, -1 on error
+*/
+int dbf_Verify(P_DBF *p_dbf, u_int32_t *checksum, int threads);
+
+/*! \fn int dbf_Sample(P_DBF *p_dbf, int nsamples, int flags, unsigned int seed, DBF_STATS *stats)
+	\brief dbf_Sample estimates statistics of all columns from a sample
+	\param *p_dbf the object handle of the opened file
+	\param nsamples the number of records to sample
+	\param flags \ref DBF_SAMPLE_STRATIFIED or 0 for a simple random sample
+	\param seed the seed of the random numbers, the same seed gives the
+	same sample
+	\param *stats memory for \ref dbf_NumCols statistics
+
+	Reads \a nsamples records at random positions, each one with a
+	single positional read, so the time does not depend on the size of
+	the table. With \ref DBF_SAMPLE_STRATIFIED the table is split into
+	\a nsamples equal parts and one record is taken from each part.
+	Tables with fewer records are read completely.
+	The number of distinct values is estimated by a HyperLogLog sketch
+	over the raw fields, with an error of about 2%. It counts the values
+	of the sample only and is not extrapolated to the table, so a column
+	of unique keys reports about the number of records sampled. Dates are
+	counted in days and datetimes in milliseconds since 1970-01-01,
+	logical fields as 1 and 0. Deleted records are skipped if
+	\ref DBF_SKIP_DELETED is set by \ref dbf_SetScanOptions. The internal
+	record counter is not changed.
+
+	\return the number of records sampled or -1 on error
+*/
+int dbf_Sample(P_DBF *p_dbf, int nsamples, int flags, unsigned int seed, DBF_STATS *stats);
+
+/*! \fn int dbf_SetAccessHint(P_DBF *p_dbf, int hint)
+	\brief dbf_SetAccessHint tells the kernel how the records will be read
+	\param *p_dbf the object handle of the opened file
+	\param hint \ref DBF_ACCESS_NORMAL, \ref DBF_ACCESS_SEQUENTIAL,
+	\ref DBF_ACCESS_RANDOM or \ref DBF_ACCESS_WILLNEED
+
+	Passes the hint for all records to posix_fadvise(), or to madvise()
+	for tables opened by \ref dbf_OpenMemory. \ref DBF_ACCESS_RANDOM turns
+	off the readahead of the kernel, which only wastes bandwidth when
+	records are read by \ref dbf_SetRecordOffset and \ref dbf_ReadRecord
+	in random order. Systems without these functions ignore the hint.
+
+	\return 0 on success, -1 on error
+*/
+int dbf_SetAccessHint(P_DBF *p_dbf, int hint);
+
+/*! \fn int dbf_Prefetch(P_DBF *p_dbf, const int *recnos, int n)
+	\brief dbf_Prefetch reads records in the background
+	\param *p_dbf the object handle of the opened file
+	\param *recnos the numbers of the records, counted from 0
+	\param n the number of records
+
+	Asks the kernel to read the records which will be needed soon
+	without waiting for them, so later calls of \ref dbf_ReadRecord find
+	them in the page cache. Records which follow each other in the list
+	and in the file are requested together. Record numbers out of range
+	are ignored.
+
+	\return 0 on success, -1 on error
+*/
+int dbf_Prefetch(P_DBF *p_dbf, const int *recnos, int n);
+
+/*! \fn DBF_SET *dbf_OpenSet(const char **files, int nfiles, int maxopen)
+	\brief dbf_OpenSet opens many files with the same fields as one table
+	\param **files the names of the files
+	\param nfiles the number of files
+	\param maxopen the maximum number of files read at the same time
+	during \ref dbf_ScanSet, 0 for one per thread. The first file stays
+	open as well, so up to \a maxopen + 1 files are open.
+
+	Opens every file to compare its fields with the fields of the first
+	file. Name, type, length and decimals of all fields must be the same.
+	Only the first file stays open, it describes the fields of the set
+	for \ref dbf_NumCols, \ref dbf_DecodeRecord and similar functions.
+
+	\return the handle of the set or NULL if a file cannot be opened or
+	its fields differ
+*/
+DBF_SET *dbf_OpenSet(const char **files, int nfiles, int maxopen);
+
+/*! \fn void dbf_CloseSet(DBF_SET *set)
+	\brief dbf_CloseSet closes a set opened by \ref dbf_OpenSet
+	\param *set the handle of the set
+*/
+void dbf_CloseSet(DBF_SET *set);
+
+/*! \fn P_DBF *dbf_SetSchema(DBF_SET *set)
+	\brief dbf_SetSchema returns the first file of the set
+	\param *set the handle of the set
+
+	The handle describes the fields of all files of the set and decodes
+	the records passed to the callback of \ref dbf_ScanSet. Its scan
+	options set by \ref dbf_SetScanOptions apply to the whole set. It is
+	closed by \ref dbf_CloseSet.
+*/
+P_DBF *dbf_SetSchema(DBF_SET *set);
+
+/*! \fn long dbf_SetNumRows(DBF_SET *set)
+	\brief dbf_SetNumRows returns the number of records of all files
+	\param *set the handle of the set
+*/
+long dbf_SetNumRows(DBF_SET *set);
+
+/*! \fn long dbf_ScanSet(DBF_SET *set, DBF_SCAN callback, void *ctx, int threads)
+	\brief dbf_ScanSet passes all records of all files to a callback
+	\param *set the handle of the set
+	\param callback the function called for every record
+	\param *ctx passed to the callback
+	\param threads the number of threads, 0 for one per CPU
+
+	All files are split into chunks of about 1 MB, which are read by
+	one pool of threads, so large files and many small files are
+	scanned in parallel alike. With one thread the records are passed
+	in the order of the files and within the files, with more threads
+	the callback is called from several threads at the same time.
+	Each thread keeps the file of its current chunk open and no more
+	threads are started than \a maxopen of \ref dbf_OpenSet allows.
+	Deleted records are skipped if \ref DBF_SKIP_DELETED is set for
+	\ref dbf_SetSchema.
+
+	\return the number of records passed to the callback or -1 on error
+*/
+long dbf_ScanSet(DBF_SET *set, DBF_SCAN callback, void *ctx, int threads);
+
+/*! \fn long dbf_Sort(P_DBF *p_dbf, const char *file, int column, int flags, size_t memory, int threads)
+	\brief dbf_Sort writes the records sorted by one column into a new file
+	\param *p_dbf the object handle of the opened file
+	\param *file the name of the new file, which is replaced if it exists
+	\param column the number of the column to sort by
+	\param flags \ref DBF_SORT_DESC or 0 for ascending order
+	\param memory the number of bytes to hold records in memory, 0 for
+	64 MB
+	\param threads the number of threads, 0 for one per CPU
+
+	Tables larger than \a memory are sorted in runs which are written to
+	temporary files and merged into the new file at the end, so tables
+	of any size can be sorted. Character fields are compared byte by
+	byte, all other fields by their value, with blank and null fields
+	first. Records with equal keys keep their order. Deleted records are
+	left out if \ref DBF_SKIP_DELETED is set by \ref dbf_SetScanOptions.
+	The new file gets the header and fields of the table.
+
+	\return the number of records written or -1 on error
+*/
+long dbf_Sort(P_DBF *p_dbf, const char *file, int column, int flags, size_t memory, int threads);
+
+/*! \fn long dbf_HashJoin(P_DBF *build, int buildcol, P_DBF *probe, int probecol, DBF_JOIN callback, void *ctx, int threads)
+	\brief dbf_HashJoin passes all pairs of records with equal keys to a callback
+	\param *build the smaller table, which is held in memory
+	\param buildcol the number of the key column of the build table
+	\param *probe the larger table, which is read in chunks
+	\param probecol the number of the key column of the probe table
+	\param callback the function called for every pair
+	\param *ctx passed to the callback
+	\param threads the number of threads, 0 for one per CPU
+
+	Builds a hash table over the raw keys of the build table and looks
+	up the key of every record of the probe table, which is read by
+	several threads at the same time. The records are passed as they
+	are in the files, without copying or decoding them. Character,
+	date and numeric keys are compared without the blanks which pad
+	them, so the columns may have different lengths. Blank keys never
+	match. The binary fields of Visual FoxPro are compared at their full
+	width, null fields never match. Pairs of one probe record
+	are passed in the order of the build table. Deleted records of
+	either table are left out if \ref DBF_SKIP_DELETED is set for it by
+	\ref dbf_SetScanOptions.
+
+	\return the number of pairs passed to the callback or -1 on error
+*/
+long dbf_HashJoin(P_DBF *build, int buildcol, P_DBF *probe, int probecol, DBF_JOIN callback, void *ctx, int threads);
+
+/*! \fn int dbf_Refresh(P_DBF *p_dbf)
+	\brief dbf_Refresh reads the number of records again
+	\param *p_dbf the object handle of the opened file
+
+	Reads the number of records from the header of the file, which may
+	have been changed by another process appending records. Files opened
+	with \ref DBF_OPEN_SHARED are appended to under a lock of the header
+	and every record is written before the header counts it, so all
+	records up to the number read are complete. Only four bytes are
+	read, under a shared lock which is held for this read only, so
+	reading the records themselves takes no locks at all.
+	The locks are byte range locks at the offsets used by Visual FoxPro,
+	which are compatible with other programs following this convention.
+
+	\return the number of records or -1 on error
+*/
+int dbf_Refresh(P_DBF *p_dbf);
+
+/*! \fn int dbf_LockRecord(P_DBF *p_dbf, int recno, int exclusive)
+	\brief dbf_LockRecord locks a record against other processes
+	\param *p_dbf the object handle of the opened file
+	\param recno the number of the record, counted from 0
+	\param exclusive 1 for a write lock, 0 for a read lock
+
+	Waits until the record can be locked. Records are locked at the
+	offsets used by Visual FoxPro, behind the end of the file. Does
+	nothing unless the file was opened with \ref DBF_OPEN_SHARED.
+
+	\return 0 on success, -1 on error
+*/
+int dbf_LockRecord(P_DBF *p_dbf, int recno, int exclusive);
+
+/*! \fn int dbf_UnlockRecord(P_DBF *p_dbf, int recno)
+	\brief dbf_UnlockRecord releases a lock taken by \ref dbf_LockRecord
+	\param *p_dbf the object handle of the opened file
+	\param recno the number of the record, counted from 0
+
+	\return 0 on success, -1 on error
+*/
+int dbf_UnlockRecord(P_DBF *p_dbf, int recno);
+
+/*! \fn long dbf_Follow(P_DBF *p_dbf, u_int32_t *next, DBF_FOLLOW callback, void *ctx)
+	\brief dbf_Follow passes the records appended since the last call to a callback
+	\param *p_dbf the object handle of the opened file
+	\param *next the number of the first record not passed yet, counted
+	from 0, which is updated
+	\param callback the function called for every batch of records
+	\param *ctx passed to the callback
+
+	Reads the number of records from the header by \ref dbf_Refresh and
+	passes the records from \a *next on in batches of about 1 MB, so a
+	table which grows is mirrored without reading it again. Start with
+	\a *next set to 0, or to \ref dbf_NumRows to skip the records which
+	are already there. Deleted records are passed as well. If the
+	callback stops, \a *next is the record after the last batch passed.
+
+	\return the number of records passed or -1 on error, also if the
+	table has fewer than \a *next records because it has been packed or
+	replaced
+*/
+long dbf_Follow(P_DBF *p_dbf, u_int32_t *next, DBF_FOLLOW callback, void *ctx);
+
+/*! \fn int dbf_FollowWait(P_DBF *p_dbf, u_int32_t next, int timeout)
+	\brief dbf_FollowWait waits until records are appended
+	\param *p_dbf the object handle of the opened file
+	\param next the number of records already seen
+	\param timeout the maximum time to wait in milliseconds, -1 to wait
+	without limit
+
+	Waits until the table has more than \a next records. On Linux the
+	file is watched by inotify, elsewhere the header is read again every
+	100 ms.
+
+	\return 1 if there are new records, 0 on timeout and -1 on error
+*/
+int dbf_FollowWait(P_DBF *p_dbf, u_int32_t next, int timeout);
+
+/*! \fn void dbf_ClearRecord(P_DBF *p_dbf, char *record)
+	\brief dbf_ClearRecord sets all fields of a record blank
+	\param *p_dbf the object handle of the opened file
+	\param *record the record of \ref dbf_RecordLength - 1 bytes, as
+	passed to \ref dbf_WriteRecord
+
+	Fills text fields with blanks and binary fields of Visual FoxPro
+	with zeros. The record can then be filled by \ref dbf_PutInt64,
+	\ref dbf_PutDouble, \ref dbf_PutDate, \ref dbf_PutBool,
+	\ref dbf_PutString and \ref dbf_PutNull, which format the values
+	into the fields without allocating memory, so one record buffer can
+	be used for all records written.
+*/
+void dbf_ClearRecord(P_DBF *p_dbf, char *record);
+
+/*! \fn int dbf_PutInt64(P_DBF *p_dbf, char *record, int column, int64_t value)
+	\brief dbf_PutInt64 puts an integer into a field of a record
+	\param *p_dbf the object handle of the opened file
+	\param *record the record as passed to \ref dbf_WriteRecord
+	\param column the number of the column
+	\param value the value
+
+	Works for numeric, float, character, logical and the integer,
+	double and currency fields of Visual FoxPro. Numbers are aligned
+	right with the decimals of the field.
+
+	\return 0 on success, -1 if the column cannot hold the value, the
+	record is then left unchanged
+*/
+int dbf_PutInt64(P_DBF *p_dbf, char *record, int column, int64_t value);
+
+/*! \fn int dbf_PutDouble(P_DBF *p_dbf, char *record, int column, double value)
+	\brief dbf_PutDouble puts a number into a field of a record
+	\param *p_dbf the object handle of the opened file
+	\param *record the record as passed to \ref dbf_WriteRecord
+	\param column the number of the column
+	\param value the value
+
+	Works for numeric and float fields, which are rounded to their
+	decimals, and the integer, double and currency fields of Visual
+	FoxPro.
+
+	\return 0 on success, -1 if the column cannot hold the value, the
+	record is then left unchanged
+*/
+int dbf_PutDouble(P_DBF *p_dbf, char *record, int column, double value);
+
+/*! \fn int dbf_PutDate(P_DBF *p_dbf, char *record, int column, int year, int month, int day)
+	\brief dbf_PutDate puts a date into a field of a record
+	\param *p_dbf the object handle of the opened file
+	\param *record the record as passed to \ref dbf_WriteRecord
+	\param column the number of the column
+	\param year the year
+	\param month the month, 1 to 12
+	\param day the day of the month
+
+	Works for date fields and the datetime fields of Visual FoxPro, which
+	get midnight as time.
+
+	\return 0 on success, -1 on error or if the day does not exist, like
+	February 31st
+*/
+int dbf_PutDate(P_DBF *p_dbf, char *record, int column, int year, int month, int day);
+
+/*! \fn int dbf_PutBool(P_DBF *p_dbf, char *record, int column, int value)
+	\brief dbf_PutBool puts T or F into a logical field of a record
+	\param *p_dbf the object handle of the opened file
+	\param *record the record as passed to \ref dbf_WriteRecord
+	\param column the number of the column
+	\param value any value but 0 for true
+
+	\return 0 on success, -1 on error
+*/
+int dbf_PutBool(P_DBF *p_dbf, char *record, int column, int value);
+
+/*! \fn int dbf_PutString(P_DBF *p_dbf, char *record, int column, const char *value, int len)
+	\brief dbf_PutString puts text into a field of a record
+	\param *p_dbf the object handle of the opened file
+	\param *record the record as passed to \ref dbf_WriteRecord
+	\param column the number of the column
+	\param *value the text, which is not converted
+	\param len the length of the text, -1 if it is 0-terminated
+
+	Text is aligned left and cut to the length of the field, in numeric
+	and float fields it is aligned right. Binary fields of Visual FoxPro
+	cannot hold text.
+
+	\return 0 on success, -1 on error or if the text does not fit into a
+	numeric field
+*/
+int dbf_PutString(P_DBF *p_dbf, char *record, int column, const char *value, int len);
+
+/*! \fn int dbf_PutNull(P_DBF *p_dbf, char *record, int column)
+	\brief dbf_PutNull sets a field of a record to null
+	\param *p_dbf the object handle of the opened file
+	\param *record the record as passed to \ref dbf_WriteRecord
+	\param column the number of the column
+
+	Sets the field blank, or to zero for binary fields, and sets its bit
+	in the _NullFlags field if the column can be null. The other
+	functions putting values clear the bit again.
+
+	\return 0 on success, -1 on error
+*/
+int dbf_PutNull(P_DBF *p_dbf, char *record, int column);
+
+/*! \fn int dbf_Snapshot(P_DBF *p_dbf, const char *file)
+	\brief dbf_Snapshot copies the table and its memo file
+	\param *p_dbf the object handle of the opened file
+	\param *file the name of the copy, which is replaced if it exists
+
+	Writes the updates held in the cache to the table first. On
+	filesystems supporting reflinks, like btrfs and XFS, the copy shares
+	all blocks with the table and takes no time regardless of its size,
+	blocks are only copied when either file is modified later. Elsewhere
+	the file is copied by copy_file_range() within the kernel if
+	available, or by reading and writing it. A memo file next to the
+	table is copied as well, to a file named like \a file with the
+	extension of the memo file. Tables opened by \ref dbf_OpenMemory
+	are written to \a file.
+
+	\return 0 on success, -1 on error
+*/
+int dbf_Snapshot(P_DBF *p_dbf, const char *file);
+
+/*! \fn long dbf_Restructure(P_DBF *p_dbf, const char *file, DB_FIELD *fields, const int *map, int numfields, int version)
+	\brief dbf_Restructure copies the records into a file with other fields
+	\param *p_dbf the object handle of the opened file
+	\param *file the name of the new file, which is replaced if it exists
+	\param *fields the fields of the new file, set up by \ref dbf_SetField
+	\param *map the number of the column of the table for each field, -1
+	for a new field which is left blank
+	\param numfields the number of fields
+	\param version the version byte of the new file, 0 to keep the
+	version of the table without its memo file
+
+	Columns can be dropped, reordered, renamed and added. Character fields
+	can be made shorter or longer, numeric and float fields longer with
+	the same decimals. All other fields must keep type and length, values
+	are never converted. The mapping is turned into a few copy and fill
+	operations per record, adjacent columns which keep their order are
+	copied together, and the records are read and written in blocks of
+	about 1 MB. Neither Visual FoxPro versions nor memo files can be
+	written, so memo (M, G, P) and binary (I, B, Y, T) fields are refused,
+	and so are nullable columns of the table unless they are dropped.
+	Deleted records are left out if \ref DBF_SKIP_DELETED is set by
+	\ref dbf_SetScanOptions, otherwise they stay deleted.
+
+	\return the number of records written or -1 on error or if a column
+	cannot be copied into its new field
+*/
+long dbf_Restructure(P_DBF *p_dbf, const char *file, DB_FIELD *fields, const int *map, int numfields, int version);
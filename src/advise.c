@@ -0,0 +1,145 @@
+/*****************************************************************************
+ * advise.c
+ *****************************************************************************
+ * Tells the kernel how dBASE files are going to be accessed
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MADVISE)
+#include <sys/mman.h>
+#define DBF_MADVISE 1
+#endif
+
+/* static dbf_Advise() {{{
+ * Passes advice for len bytes at offset to posix_fadvise() for files and
+ * to madvise() for tables in memory. len 0 stands for the rest of the
+ * table. Systems without these functions ignore the advice.
+ */
+static int dbf_Advise(P_DBF *p_dbf, off_t offset, off_t len, int hint)
+{
+	if (p_dbf->mem) {
+#ifdef DBF_MADVISE
+		long pagesize = sysconf(_SC_PAGESIZE);
+		const unsigned char *addr;
+		size_t skew;
+		int advice;
+
+		if (len == 0 || offset + len > (off_t) p_dbf->mem_len)
+			len = p_dbf->mem_len - offset;
+		if (offset >= (off_t) p_dbf->mem_len || len <= 0 || pagesize <= 0)
+			return 0;
+		/* madvise() needs page aligned addresses */
+		addr = p_dbf->mem + offset;
+		skew = (size_t) addr % pagesize;
+
+		switch (hint) {
+			case DBF_ACCESS_SEQUENTIAL:
+				advice = MADV_SEQUENTIAL;
+				break;
+			case DBF_ACCESS_RANDOM:
+				advice = MADV_RANDOM;
+				break;
+			case DBF_ACCESS_WILLNEED:
+				advice = MADV_WILLNEED;
+				break;
+			default:
+				advice = MADV_NORMAL;
+				break;
+		}
+		return madvise((void *) (addr - skew), len + skew, advice) == 0 ? 0 : -1;
+#else
+		return 0;
+#endif
+	}
+
+#ifdef HAVE_POSIX_FADVISE
+	{
+		int advice;
+
+		switch (hint) {
+			case DBF_ACCESS_SEQUENTIAL:
+				advice = POSIX_FADV_SEQUENTIAL;
+				break;
+			case DBF_ACCESS_RANDOM:
+				advice = POSIX_FADV_RANDOM;
+				break;
+			case DBF_ACCESS_WILLNEED:
+				advice = POSIX_FADV_WILLNEED;
+				break;
+			default:
+				advice = POSIX_FADV_NORMAL;
+				break;
+		}
+		/* posix_fadvise() returns the error instead of setting errno */
+		if (0 != (errno = posix_fadvise(p_dbf->dbf_fh, offset, len, advice)))
+			return -1;
+	}
+#endif
+
+	return 0;
+}
+/* }}} */
+
+/* dbf_SetAccessHint() {{{
+ * Tells the kernel how the records are going to be read
+ */
+int dbf_SetAccessHint(P_DBF *p_dbf, int hint)
+{
+	if (hint < DBF_ACCESS_NORMAL || hint > DBF_ACCESS_WILLNEED)
+		return -1;
+
+	return dbf_Advise(p_dbf, p_dbf->header->header_length, 0, hint);
+}
+/* }}} */
+
+/* dbf_Prefetch() {{{
+ * Starts reading the given records in the background. Records which are
+ * adjacent in the list and in the file are requested together.
+ */
+int dbf_Prefetch(P_DBF *p_dbf, const int *recnos, int n)
+{
+	u_int32_t reclen = p_dbf->header->record_length;
+	off_t start = 0, end = 0, offset;
+	int i, ret = 0;
+
+	for (i = 0; i < n; i++) {
+		if (recnos[i] < 0 || (u_int32_t) recnos[i] >= p_dbf->header->records)
+			continue;
+		offset = p_dbf->header->header_length + (off_t) recnos[i] * reclen;
+		if (end > start && offset >= start && offset <= end) {
+			if (offset + reclen > end)
+				end = offset + reclen;
+			continue;
+		}
+		if (end > start && dbf_Advise(p_dbf, start, end - start, DBF_ACCESS_WILLNEED) < 0)
+			ret = -1;
+		start = offset;
+		end = offset + reclen;
+	}
+	if (end > start && dbf_Advise(p_dbf, start, end - start, DBF_ACCESS_WILLNEED) < 0)
+		ret = -1;
+
+	return ret;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,410 @@
+/*****************************************************************************
+ * aggregate.c
+ *****************************************************************************
+ * Computes count, sum, minimum and maximum of columns of dBASE files
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/*
+ * The records are read in chunks of about DBF_BLOCK_SIZE bytes, which
+ * are taken by the workers in any order. Each worker sums up into its
+ * own hash table of groups, the tables are merged when all chunks are
+ * done. Without grouping all records fall into one group with an empty
+ * key.
+ */
+
+struct dbf_Group {
+	/* key of the group, NULL if the slot is empty */
+	char *key;
+	int keylen;
+	u_int32_t hash;
+	DBF_AGGREGATE agg;
+	/* set if isum overflowed, sum is then used instead */
+	int overflow;
+};
+
+struct dbf_GroupTable {
+	struct dbf_Group *slots;
+	/* number of slots, a power of two */
+	int size;
+	int used;
+};
+
+struct dbf_Agg {
+	P_DBF *p_dbf;
+	int column;
+	int groupby;
+	/* records per chunk */
+	u_int32_t chunkrecs;
+	/* per worker: buffer of a chunk, table of groups and error flag */
+	char **raw;
+	struct dbf_GroupTable *tables;
+	int *failed;
+};
+
+/* static dbf_GroupHash() {{{
+ * FNV-1a hash of a key
+ */
+static u_int32_t dbf_GroupHash(const char *key, int len)
+{
+	u_int32_t h = 2166136261U;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char) key[i];
+		h *= 16777619U;
+	}
+
+	return h;
+}
+/* }}} */
+
+/* static dbf_GroupFind() {{{
+ * Returns the group of key, which is added if it does not exist yet.
+ * Returns NULL if memory runs out.
+ */
+static struct dbf_Group *dbf_GroupFind(struct dbf_GroupTable *t, const char *key, int len, u_int32_t hash)
+{
+	struct dbf_Group *g;
+	int i;
+
+	if (2 * (t->used + 1) > t->size) {
+		struct dbf_Group *old = t->slots;
+		int oldsize = t->size;
+		int size = oldsize ? oldsize * 2 : 64;
+
+		if (NULL == (t->slots = calloc(size, sizeof(struct dbf_Group)))) {
+			t->slots = old;
+			return NULL;
+		}
+		t->size = size;
+		for (i = 0; i < oldsize; i++) {
+			if (old[i].key) {
+				g = &t->slots[old[i].hash & (size - 1)];
+				while (g->key)
+					g = (g == &t->slots[size - 1]) ? t->slots : g + 1;
+				*g = old[i];
+			}
+		}
+		if (old)
+			free(old);
+	}
+
+	for (i = hash & (t->size - 1); ; i = (i + 1) & (t->size - 1)) {
+		g = &t->slots[i];
+		if (NULL == g->key)
+			break;
+		if (g->hash == hash && g->keylen == len && memcmp(g->key, key, len) == 0)
+			return g;
+	}
+
+	/* The key is 0-terminated for the caller */
+	if (NULL == (g->key = malloc(len + 1)))
+		return NULL;
+	memcpy(g->key, key, len);
+	g->key[len] = '\0';
+	g->keylen = len;
+	g->hash = hash;
+	t->used++;
+
+	return g;
+}
+/* }}} */
+
+/* static dbf_GroupFree() {{{
+ */
+static void dbf_GroupFree(struct dbf_GroupTable *t)
+{
+	int i;
+
+	for (i = 0; i < t->size; i++) {
+		if (t->slots[i].key)
+			free(t->slots[i].key);
+	}
+	if (t->slots)
+		free(t->slots);
+	t->slots = NULL;
+	t->size = t->used = 0;
+}
+/* }}} */
+
+/* static dbf_AddInt64() {{{
+ * Adds v to *sum. Returns -1 and leaves *sum alone if it would overflow.
+ */
+static int dbf_AddInt64(int64_t *sum, int64_t v)
+{
+	if ((v > 0 && *sum > DBF_INT64_MAX - v) || (v < 0 && *sum < -DBF_INT64_MAX - 1 - v))
+		return -1;
+	*sum += v;
+
+	return 0;
+}
+/* }}} */
+
+/* static dbf_AggregateMerge() {{{
+ * Adds the aggregates of group src to group dst
+ */
+static void dbf_AggregateMerge(struct dbf_Group *gdst, const struct dbf_Group *gsrc)
+{
+	DBF_AGGREGATE *dst = &gdst->agg;
+	const DBF_AGGREGATE *src = &gsrc->agg;
+
+	if (src->count > 0) {
+		if (dst->count == 0 || src->min < dst->min)
+			dst->min = src->min;
+		if (dst->count == 0 || src->max > dst->max)
+			dst->max = src->max;
+	}
+	dst->records += src->records;
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (gsrc->overflow || 0 > dbf_AddInt64(&dst->isum, src->isum))
+		gdst->overflow = 1;
+}
+/* }}} */
+
+/* static dbf_AggregateChunk() {{{
+ * Reads one chunk and adds its records to the table of the worker
+ */
+static void dbf_AggregateChunk(void *ctx, int task, int worker)
+{
+	struct dbf_Agg *a = ctx;
+	P_DBF *p_dbf = a->p_dbf;
+	const DBF_PLAN *plan = p_dbf->plan;
+	struct dbf_GroupTable *t = &a->tables[worker];
+	struct dbf_Group *g = NULL;
+	DBF_DECODER decode = plan->decode[a->column];
+	u_int32_t reclen = p_dbf->header->record_length;
+	u_int32_t offset = plan->offset[a->column];
+	int length = plan->length[a->column];
+	const char *records, *rec, *key = "";
+	DBF_VALUE value;
+	double v;
+	int64_t iv;
+	int n, i, keylen = 0, exact;
+
+	if (a->failed[worker])
+		return;
+	n = dbf_ReadBlock(p_dbf, task * a->chunkrecs, a->chunkrecs, a->raw[worker], &records);
+	if (n < 0) {
+		a->failed[worker] = 1;
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		rec = records + i * reclen;
+		if ((p_dbf->scan_options & DBF_SKIP_DELETED) && rec[0] == '*')
+			continue;
+
+		if (a->groupby >= 0) {
+			key = rec + plan->offset[a->groupby];
+			keylen = plan->length[a->groupby];
+			while (keylen > 0 && (key[keylen-1] == ' ' || key[keylen-1] == '\0'))
+				keylen--;
+		}
+		/* Consecutive records often belong to the same group */
+		if (NULL == g || g->keylen != keylen || memcmp(g->key, key, keylen) != 0) {
+			if (NULL == (g = dbf_GroupFind(t, key, keylen, dbf_GroupHash(key, keylen)))) {
+				a->failed[worker] = 1;
+				return;
+			}
+		}
+		g->agg.records++;
+
+		value.type = plan->type[a->column];
+		decode(rec + offset, length, &value);
+		exact = 1;
+		switch (value.type) {
+			case DBF_VALUE_DOUBLE:
+				v = value.v.d;
+				exact = 0;
+				iv = 0;
+				break;
+			case DBF_VALUE_INT:
+			case DBF_VALUE_DATETIME:
+				iv = value.v.i;
+				v = (double) iv;
+				break;
+			case DBF_VALUE_CURRENCY:
+				iv = value.v.i;
+				v = (double) iv / 10000;
+				break;
+			case DBF_VALUE_DATE:
+				iv = value.v.days;
+				v = iv;
+				break;
+			case DBF_VALUE_BOOL:
+				iv = value.v.b;
+				v = iv;
+				break;
+			default:
+				/* Blank or not a number */
+				continue;
+		}
+		if (p_dbf->null_bits && dbf_IsNull(p_dbf, rec, a->column) == 1)
+			continue;
+
+		if (g->agg.count == 0 || v < g->agg.min)
+			g->agg.min = v;
+		if (g->agg.count == 0 || v > g->agg.max)
+			g->agg.max = v;
+		/* Integers are summed up exactly, in any order of the chunks,
+		 * unless the sum gets too large
+		 */
+		if (exact && 0 > dbf_AddInt64(&g->agg.isum, iv))
+			g->overflow = 1;
+		g->agg.sum += v;
+		g->agg.count++;
+	}
+}
+/* }}} */
+
+/* static dbf_AggregateCompare() {{{
+ */
+static int dbf_AggregateCompare(const void *a, const void *b)
+{
+	const DBF_AGGREGATE *x = a, *y = b;
+	int len = x->keylen < y->keylen ? x->keylen : y->keylen;
+	int ret = memcmp(x->key, y->key, len);
+
+	if (ret)
+		return ret;
+	return x->keylen - y->keylen;
+}
+/* }}} */
+
+/* dbf_Aggregate() {{{
+ * Computes count, sum, minimum and maximum of a column, optionally per
+ * value of a character column
+ */
+DBF_AGGREGATE *dbf_Aggregate(P_DBF *p_dbf, int column, int groupby, int *ngroups, int threads)
+{
+	struct dbf_Agg a;
+	struct dbf_GroupTable merged = { NULL, 0, 0 };
+	struct dbf_Group *g;
+	DBF_AGGREGATE *result = NULL;
+	u_int32_t reclen = p_dbf->header->record_length;
+	u_int32_t nchunks;
+	size_t keys = 0;
+	char *key;
+	int i, w, n;
+
+	if (column < 0 || column >= (int) p_dbf->columns || NULL == p_dbf->plan || reclen == 0)
+		return NULL;
+	if (groupby >= (int) p_dbf->columns || p_dbf->plan->type[column] == DBF_VALUE_STRING)
+		return NULL;
+	if (groupby >= 0 && p_dbf->fields[groupby].field_type != 'C')
+		return NULL;
+
+	memset(&a, 0, sizeof(a));
+	a.p_dbf = p_dbf;
+	a.column = column;
+	a.groupby = groupby;
+	a.chunkrecs = DBF_BLOCK_SIZE / reclen;
+	if (a.chunkrecs == 0)
+		a.chunkrecs = 1;
+	nchunks = (p_dbf->header->records + a.chunkrecs - 1) / a.chunkrecs;
+	threads = dbf_TableThreads(p_dbf, threads);
+
+	a.raw = calloc(threads, sizeof(char *));
+	a.tables = calloc(threads, sizeof(struct dbf_GroupTable));
+	a.failed = calloc(threads, sizeof(int));
+	if (!a.raw || !a.tables || !a.failed)
+		goto cleanup;
+	for (w = 0; w < threads; w++) {
+		if (NULL == p_dbf->mem && NULL == (a.raw[w] = malloc(a.chunkrecs * reclen)))
+			goto cleanup;
+	}
+
+	dbf_RunTasks(threads, nchunks, dbf_AggregateChunk, &a);
+
+	/* Without grouping there is one result even for empty tables */
+	if (groupby < 0 && NULL == dbf_GroupFind(&merged, "", 0, dbf_GroupHash("", 0)))
+		goto cleanup;
+	for (w = 0; w < threads; w++) {
+		if (a.failed[w])
+			goto cleanup;
+		for (i = 0; i < a.tables[w].size; i++) {
+			struct dbf_Group *src = &a.tables[w].slots[i];
+
+			if (NULL == src->key)
+				continue;
+			if (NULL == (g = dbf_GroupFind(&merged, src->key, src->keylen, src->hash)))
+				goto cleanup;
+			dbf_AggregateMerge(g, src);
+		}
+	}
+
+	/* The results and their keys are returned in one block */
+	for (i = 0; i < merged.size; i++) {
+		if (merged.slots[i].key)
+			keys += merged.slots[i].keylen + 1;
+	}
+	if (NULL == (result = malloc(merged.used * sizeof(DBF_AGGREGATE) + keys + 1)))
+		goto cleanup;
+	key = (char *) (result + merged.used);
+	for (i = 0, n = 0; i < merged.size; i++) {
+		g = &merged.slots[i];
+		if (NULL == g->key)
+			continue;
+		result[n] = g->agg;
+		if (g->overflow)
+			result[n].isum = 0;
+		switch (g->overflow ? DBF_VALUE_DOUBLE : p_dbf->plan->type[column]) {
+			case DBF_VALUE_DOUBLE:
+				break;
+			case DBF_VALUE_CURRENCY:
+				result[n].sum = (double) result[n].isum / 10000;
+				break;
+			default:
+				result[n].sum = (double) result[n].isum;
+				break;
+		}
+		result[n].key = key;
+		result[n].keylen = g->keylen;
+		memcpy(key, g->key, g->keylen + 1);
+		key += g->keylen + 1;
+		n++;
+	}
+	qsort(result, n, sizeof(DBF_AGGREGATE), dbf_AggregateCompare);
+	*ngroups = n;
+
+cleanup:
+	dbf_GroupFree(&merged);
+	for (w = 0; w < threads; w++) {
+		if (a.raw && a.raw[w])
+			free(a.raw[w]);
+		if (a.tables)
+			dbf_GroupFree(&a.tables[w]);
+	}
+	if (a.raw)
+		free(a.raw);
+	if (a.tables)
+		free(a.tables);
+	if (a.failed)
+		free(a.failed);
+
+	return result;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
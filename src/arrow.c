@@ -0,0 +1,700 @@
+/*****************************************************************************
+ * arrow.c
+ *****************************************************************************
+ * Exports dBASE files as Apache Arrow IPC streams
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/*
+ * An Arrow IPC stream consists of a schema message followed by record
+ * batch messages and an end marker. Each message is a flatbuffer holding
+ * the metadata, followed by the body with the column buffers. The few
+ * flatbuffer tables needed are written by the minimal builder below,
+ * which places every table in front of the objects it references.
+ */
+
+/* Members of the Type union of Schema.fbs */
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOAT 3
+#define ARROW_TYPE_BINARY 4
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_BOOL 6
+#define ARROW_TYPE_DECIMAL 7
+#define ARROW_TYPE_DATE 8
+#define ARROW_TYPE_TIMESTAMP 10
+
+/* Members of the MessageHeader union of Message.fbs */
+#define ARROW_MESSAGE_SCHEMA 1
+#define ARROW_MESSAGE_RECORDBATCH 3
+
+/* MetadataVersion V5 */
+#define ARROW_VERSION 4
+
+/* records per batch by default and the size of their fields at most */
+#define DBF_ARROW_BATCH_ROWS 65536
+#define DBF_ARROW_BATCH_BYTES (64 * 1024 * 1024)
+
+/* Column types the dBASE field types are mapped onto */
+enum {
+	DBF_ARROW_UTF8,
+	DBF_ARROW_BINARY,
+	DBF_ARROW_INT64,
+	DBF_ARROW_INT32,
+	DBF_ARROW_DOUBLE,
+	DBF_ARROW_BINDOUBLE,
+	DBF_ARROW_DATE32,
+	DBF_ARROW_BOOL,
+	DBF_ARROW_TIMESTAMP,
+	DBF_ARROW_DECIMAL
+};
+
+struct dbf_ArrowColumn {
+	int type;
+	int column;
+	/* position of the field within the record */
+	int offset;
+	int length;
+	/* bytes per value, 0 for bool and variable length types */
+	int width;
+	/* convert the characters of the field to UTF-8 */
+	int transcode;
+	/* remove trailing blanks */
+	int trim;
+	unsigned char *validity;
+	unsigned char *values;
+	int32_t *offsets;
+	unsigned char *data;
+	long nulls;
+};
+
+struct dbf_FB {
+	unsigned char *buf;
+	size_t len;
+	size_t size;
+};
+
+/* static fb_alloc() {{{
+ * Reserves len bytes aligned to align and returns their position
+ */
+static size_t fb_alloc(struct dbf_FB *fb, size_t len, size_t align)
+{
+	size_t pos = (fb->len + align - 1) & ~(align - 1);
+	unsigned char *buf;
+
+	if (pos + len > fb->size) {
+		size_t size = fb->size ? fb->size : 1024;
+		while (size < pos + len)
+			size *= 2;
+		if (NULL == (buf = realloc(fb->buf, size)))
+			return (size_t) -1;
+		fb->buf = buf;
+		fb->size = size;
+	}
+	memset(fb->buf + fb->len, 0, pos + len - fb->len);
+	fb->len = pos + len;
+	return pos;
+}
+/* }}} */
+
+/* static fb_put() {{{
+ * Stores a little endian integer of size bytes at pos
+ */
+static void fb_put(struct dbf_FB *fb, size_t pos, u_int64_t value, int size)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		fb->buf[pos + i] = (unsigned char) (value >> (8 * i));
+}
+/* }}} */
+
+/* static fb_patch() {{{
+ * Lets the offset at pos point to the object at target
+ */
+static void fb_patch(struct dbf_FB *fb, size_t pos, size_t target)
+{
+	fb_put(fb, pos, target - pos, 4);
+}
+/* }}} */
+
+/* static fb_table() {{{
+ * Writes a table with nfields fields of the given sizes, 0 for fields
+ * which are not set, preceded by its vtable. The positions of the fields
+ * are stored in pos. Returns the position of the table.
+ */
+static size_t fb_table(struct dbf_FB *fb, int nfields, const int *sizes, size_t *pos)
+{
+	size_t vt, t;
+	int i;
+
+	vt = fb_alloc(fb, 4 + 2 * nfields, 2);
+	t = fb_alloc(fb, 4, 8);
+	for (i = 0; i < nfields; i++)
+		pos[i] = sizes[i] ? fb_alloc(fb, sizes[i], sizes[i]) : 0;
+
+	fb_put(fb, vt, 4 + 2 * nfields, 2);
+	fb_put(fb, vt + 2, fb->len - t, 2);
+	for (i = 0; i < nfields; i++)
+		fb_put(fb, vt + 4 + 2 * i, sizes[i] ? pos[i] - t : 0, 2);
+	fb_put(fb, t, t - vt, 4);
+
+	return t;
+}
+/* }}} */
+
+/* static fb_vector() {{{
+ * Writes the length of a vector of count elements of size bytes and
+ * reserves the elements, which follow at the returned position + 4.
+ */
+static size_t fb_vector(struct dbf_FB *fb, u_int32_t count, size_t size)
+{
+	size_t pos, align = size < 4 ? 4 : size;
+
+	/* The elements, not the length, need to be aligned */
+	if ((size_t) -1 == fb_alloc(fb, (align - (fb->len + 4) % align) % align, 1))
+		return (size_t) -1;
+	if ((size_t) -1 == (pos = fb_alloc(fb, 4 + count * size, 4)))
+		return (size_t) -1;
+	fb_put(fb, pos, count, 4);
+
+	return pos;
+}
+/* }}} */
+
+/* static fb_string() {{{
+ */
+static size_t fb_string(struct dbf_FB *fb, const char *str, size_t len)
+{
+	size_t pos;
+
+	pos = fb_alloc(fb, 4 + len + 1, 4);
+	fb_put(fb, pos, len, 4);
+	memcpy(fb->buf + pos + 4, str, len);
+
+	return pos;
+}
+/* }}} */
+
+/* static dbf_ArrowBigEndian() {{{
+ */
+static int dbf_ArrowBigEndian(void)
+{
+	u_int16_t one = 1;
+
+	return *(unsigned char *) &one == 0;
+}
+/* }}} */
+
+/* static dbf_ArrowMessage() {{{
+ * Starts a message in fb and returns the position of the header offset.
+ * The position of the body length is stored in bodypos.
+ */
+static size_t dbf_ArrowMessage(struct dbf_FB *fb, int type, size_t *bodypos)
+{
+	int sizes[4] = { 2, 1, 4, 8 };
+	size_t pos[4], root;
+
+	fb->len = 0;
+	root = fb_alloc(fb, 4, 4);
+	fb_patch(fb, root, fb_table(fb, 4, sizes, pos));
+	fb_put(fb, pos[0], ARROW_VERSION, 2);
+	fb_put(fb, pos[1], type, 1);
+	*bodypos = pos[3];
+
+	return pos[2];
+}
+/* }}} */
+
+/* static dbf_ArrowWrite() {{{
+ * Writes the message in fb, padded to 8 bytes, and its body
+ */
+static int dbf_ArrowWrite(int fd, struct dbf_FB *fb, const unsigned char *body, size_t bodylen)
+{
+	unsigned char prefix[8];
+	size_t len;
+
+	len = (fb->len + 7) & ~7;
+	if ((size_t) -1 == fb_alloc(fb, len - fb->len, 1))
+		return -1;
+	memset(prefix, 0xFF, 4);
+	prefix[4] = len & 0xFF;
+	prefix[5] = (len >> 8) & 0xFF;
+	prefix[6] = (len >> 16) & 0xFF;
+	prefix[7] = (len >> 24) & 0xFF;
+
+	if (dbf_WriteAll(fd, (const char *) prefix, 8) < 0 ||
+		dbf_WriteAll(fd, (const char *) fb->buf, len) < 0)
+		return -1;
+	if (bodylen > 0 && dbf_WriteAll(fd, (const char *) body, bodylen) < 0)
+		return -1;
+
+	return 0;
+}
+/* }}} */
+
+/* static dbf_ArrowSchema() {{{
+ * Writes the schema message describing all columns
+ */
+static int dbf_ArrowSchema(P_DBF *p_dbf, int fd, struct dbf_FB *fb, struct dbf_ArrowColumn *cols)
+{
+	int schema_sizes[2] = { 2, 4 };
+	int field_sizes[6] = { 4, 1, 1, 4, 0, 4 };
+	size_t header, bodypos, schema, pos[6], fpos[6], tpos[3], fields, field;
+	int i, type;
+
+	header = dbf_ArrowMessage(fb, ARROW_MESSAGE_SCHEMA, &bodypos);
+	schema = fb_table(fb, 2, schema_sizes, pos);
+	fb_patch(fb, header, schema);
+	fb_put(fb, pos[0], dbf_ArrowBigEndian(), 2);
+	fields = fb_vector(fb, p_dbf->columns, 4);
+	fb_patch(fb, pos[1], fields);
+
+	for (i = 0; i < (int) p_dbf->columns; i++) {
+		const char *name = (const char *) p_dbf->fields[i].field_name;
+
+		field = fb_table(fb, 6, field_sizes, fpos);
+		fb_patch(fb, fields + 4 + 4 * i, field);
+		fb_patch(fb, fpos[0], fb_string(fb, name, strnlen(name, 11)));
+		fb_put(fb, fpos[1], 1, 1);
+		fb_patch(fb, fpos[5], fb_vector(fb, 0, 4));
+
+		switch (cols[i].type) {
+			case DBF_ARROW_INT64:
+			case DBF_ARROW_INT32: {
+				int sizes[2] = { 4, 1 };
+				type = ARROW_TYPE_INT;
+				fb_patch(fb, fpos[3], fb_table(fb, 2, sizes, tpos));
+				fb_put(fb, tpos[0], cols[i].type == DBF_ARROW_INT64 ? 64 : 32, 4);
+				fb_put(fb, tpos[1], 1, 1);
+				break;
+			}
+			case DBF_ARROW_DOUBLE:
+			case DBF_ARROW_BINDOUBLE: {
+				int sizes[1] = { 2 };
+				type = ARROW_TYPE_FLOAT;
+				/* Precision DOUBLE */
+				fb_patch(fb, fpos[3], fb_table(fb, 1, sizes, tpos));
+				fb_put(fb, tpos[0], 2, 2);
+				break;
+			}
+			case DBF_ARROW_DATE32: {
+				int sizes[1] = { 2 };
+				type = ARROW_TYPE_DATE;
+				/* DateUnit DAY */
+				fb_patch(fb, fpos[3], fb_table(fb, 1, sizes, tpos));
+				fb_put(fb, tpos[0], 0, 2);
+				break;
+			}
+			case DBF_ARROW_TIMESTAMP: {
+				int sizes[1] = { 2 };
+				type = ARROW_TYPE_TIMESTAMP;
+				/* TimeUnit MILLISECOND */
+				fb_patch(fb, fpos[3], fb_table(fb, 1, sizes, tpos));
+				fb_put(fb, tpos[0], 1, 2);
+				break;
+			}
+			case DBF_ARROW_DECIMAL: {
+				int sizes[3] = { 4, 4, 4 };
+				type = ARROW_TYPE_DECIMAL;
+				/* Currency has four decimals */
+				fb_patch(fb, fpos[3], fb_table(fb, 3, sizes, tpos));
+				fb_put(fb, tpos[0], 19, 4);
+				fb_put(fb, tpos[1], 4, 4);
+				fb_put(fb, tpos[2], 128, 4);
+				break;
+			}
+			case DBF_ARROW_BOOL:
+				type = ARROW_TYPE_BOOL;
+				fb_patch(fb, fpos[3], fb_table(fb, 0, NULL, tpos));
+				break;
+			case DBF_ARROW_BINARY:
+				type = ARROW_TYPE_BINARY;
+				fb_patch(fb, fpos[3], fb_table(fb, 0, NULL, tpos));
+				break;
+			default:
+				type = ARROW_TYPE_UTF8;
+				fb_patch(fb, fpos[3], fb_table(fb, 0, NULL, tpos));
+				break;
+		}
+		fb_put(fb, fpos[2], type, 1);
+	}
+
+	return dbf_ArrowWrite(fd, fb, NULL, 0);
+}
+/* }}} */
+
+/* static dbf_ArrowAppend() {{{
+ * Appends the field of one record as row r of the column
+ */
+static void dbf_ArrowAppend(P_DBF *p_dbf, struct dbf_ArrowColumn *col, const char *rec, int r)
+{
+	const char *data = rec + col->offset;
+	int len = col->length;
+	int null = 0;
+
+	switch (col->type) {
+		case DBF_ARROW_INT64: {
+			int64_t v = 0;
+			null = dbf_ParseInt64(data, len, &v) != 0;
+			memcpy(col->values + r * 8, &v, 8);
+			break;
+		}
+		case DBF_ARROW_DOUBLE: {
+			double v = 0;
+			null = dbf_ParseDouble(data, len, &v) != 0;
+			memcpy(col->values + r * 8, &v, 8);
+			break;
+		}
+		case DBF_ARROW_DATE32: {
+			int32_t v = 0;
+			null = dbf_ParseDate(data, len, &v) != 0;
+			memcpy(col->values + r * 4, &v, 4);
+			break;
+		}
+		case DBF_ARROW_BOOL: {
+			int v = 0;
+			null = dbf_ParseLogical(data, len, &v) != 0;
+			if (v)
+				col->values[r / 8] |= 1 << (r & 7);
+			break;
+		}
+		case DBF_ARROW_INT32:
+		case DBF_ARROW_BINDOUBLE:
+			/* Swapped for the whole batch by dbf_ArrowBatch() */
+			memcpy(col->values + r * col->width, data, col->width);
+			break;
+		case DBF_ARROW_TIMESTAMP: {
+			int32_t day = (int32_t) dbf_Load32(data);
+			int32_t ms = (int32_t) dbf_Load32(data + 4);
+			int64_t v = ((int64_t) (day - DBF_JULIAN_EPOCH) * 86400000) + ms;
+			null = (day == 0 && ms == 0);
+			memcpy(col->values + r * 8, &v, 8);
+			break;
+		}
+		case DBF_ARROW_DECIMAL: {
+			int64_t lo = (int64_t) dbf_Load64(data);
+			int64_t hi = lo < 0 ? -1 : 0;
+			if (dbf_ArrowBigEndian()) {
+				memcpy(col->values + r * 16, &hi, 8);
+				memcpy(col->values + r * 16 + 8, &lo, 8);
+			} else {
+				memcpy(col->values + r * 16, &lo, 8);
+				memcpy(col->values + r * 16 + 8, &hi, 8);
+			}
+			break;
+		}
+		default: {
+			int32_t start = col->offsets[r];
+			while (col->trim && len > 0 && (data[len-1] == ' ' || data[len-1] == '\0'))
+				len--;
+			if (col->transcode)
+				len = dbf_ToUTF8(p_dbf, data, len, (char *) col->data + start);
+			else
+				memcpy(col->data + start, data, len);
+			col->offsets[r + 1] = start + len;
+			break;
+		}
+	}
+
+	if (null || (p_dbf->null_bits && dbf_IsNull(p_dbf, rec, col->column) == 1))
+		col->nulls++;
+	else
+		col->validity[r / 8] |= 1 << (r & 7);
+}
+/* }}} */
+
+/* static dbf_ArrowBuffer() {{{
+ * Appends a buffer padded to 8 bytes to the body and records its
+ * position in the buffers vector at pos
+ */
+static int dbf_ArrowBuffer(struct dbf_FB *body, struct dbf_FB *fb, size_t pos, const void *data, size_t len)
+{
+	size_t start;
+
+	if ((size_t) -1 == (start = fb_alloc(body, (len + 7) & ~7, 8)))
+		return -1;
+	if (len > 0)
+		memcpy(body->buf + start, data, len);
+	fb_put(fb, pos, start, 8);
+	fb_put(fb, pos + 8, len, 8);
+
+	return 0;
+}
+/* }}} */
+
+/* static dbf_ArrowBatch() {{{
+ * Writes a record batch of rows rows
+ */
+static int dbf_ArrowBatch(P_DBF *p_dbf, int fd, struct dbf_FB *fb, struct dbf_FB *body,
+	struct dbf_ArrowColumn *cols, int rows)
+{
+	int batch_sizes[3] = { 8, 4, 4 };
+	size_t header, bodypos, batch, pos[3], nodes, buffers, b;
+	int i, nbuffers = 0, bitmaplen = (rows + 7) / 8;
+
+	for (i = 0; i < (int) p_dbf->columns; i++)
+		nbuffers += (cols[i].type == DBF_ARROW_UTF8 || cols[i].type == DBF_ARROW_BINARY) ? 3 : 2;
+
+	header = dbf_ArrowMessage(fb, ARROW_MESSAGE_RECORDBATCH, &bodypos);
+	batch = fb_table(fb, 3, batch_sizes, pos);
+	fb_patch(fb, header, batch);
+	fb_put(fb, pos[0], rows, 8);
+	nodes = fb_vector(fb, p_dbf->columns, 16);
+	fb_patch(fb, pos[1], nodes);
+	buffers = fb_vector(fb, nbuffers, 16);
+	fb_patch(fb, pos[2], buffers);
+	if ((size_t) -1 == buffers)
+		return -1;
+
+	for (i = 0; i < (int) p_dbf->columns; i++) {
+		if (cols[i].type == DBF_ARROW_INT32)
+			dbf_SwapLE32(cols[i].values, rows);
+		else if (cols[i].type == DBF_ARROW_BINDOUBLE)
+			dbf_SwapLE64(cols[i].values, rows);
+	}
+
+	body->len = 0;
+	b = buffers + 4;
+	for (i = 0; i < (int) p_dbf->columns; i++) {
+		struct dbf_ArrowColumn *col = &cols[i];
+
+		fb_put(fb, nodes + 4 + 16 * i, rows, 8);
+		fb_put(fb, nodes + 4 + 16 * i + 8, col->nulls, 8);
+
+		if (dbf_ArrowBuffer(body, fb, b, col->validity, bitmaplen) < 0)
+			return -1;
+		b += 16;
+		if (col->type == DBF_ARROW_UTF8 || col->type == DBF_ARROW_BINARY) {
+			if (dbf_ArrowBuffer(body, fb, b, col->offsets, (rows + 1) * 4) < 0 ||
+				dbf_ArrowBuffer(body, fb, b + 16, col->data, col->offsets[rows]) < 0)
+				return -1;
+			b += 32;
+		} else {
+			if (dbf_ArrowBuffer(body, fb, b, col->values,
+					col->type == DBF_ARROW_BOOL ? (size_t) bitmaplen : (size_t) rows * col->width) < 0)
+				return -1;
+			b += 16;
+		}
+	}
+
+	/* The body length is known only now */
+	fb_put(fb, bodypos, body->len, 8);
+
+	return dbf_ArrowWrite(fd, fb, body->buf, body->len);
+}
+/* }}} */
+
+/* dbf_ExportArrow() {{{
+ * Writes all records as Arrow IPC stream into fd
+ */
+long dbf_ExportArrow(P_DBF *p_dbf, int fd, int batchsize)
+{
+	struct dbf_ArrowColumn *cols;
+	struct dbf_FB fb = { NULL, 0, 0 }, body = { NULL, 0, 0 };
+	u_int32_t reclen = p_dbf->header->record_length;
+	u_int32_t nrecs = p_dbf->header->records;
+	u_int32_t recno;
+	const char *records, *rec;
+	char *buf = NULL;
+	int i, n, rows, transcode;
+	long total = 0, ret = -1;
+
+	if (reclen == 0)
+		return -1;
+	/* Wide records get smaller batches, since every column holds a batch */
+	if (batchsize <= 0) {
+		batchsize = DBF_ARROW_BATCH_BYTES / reclen;
+		if (batchsize > DBF_ARROW_BATCH_ROWS)
+			batchsize = DBF_ARROW_BATCH_ROWS;
+		if (batchsize == 0)
+			batchsize = 1;
+	}
+
+	/* Character fields are converted to UTF-8 if the codepage is known */
+	transcode = dbf_ToUTF8(p_dbf, "", 0, (char *) &i) == 0;
+
+	if (NULL == (cols = calloc(p_dbf->columns, sizeof(struct dbf_ArrowColumn))))
+		return -1;
+	for (i = 0; i < (int) p_dbf->columns; i++) {
+		DB_FIELD *field = &p_dbf->fields[i];
+		struct dbf_ArrowColumn *col = &cols[i];
+
+		col->column = i;
+		col->trim = 1;
+		col->offset = field->field_offset;
+		col->length = field->field_length;
+		switch (field->field_type) {
+			case 'N':
+				if (field->field_decimals == 0 && field->field_length <= 18) {
+					col->type = DBF_ARROW_INT64;
+					col->width = 8;
+					break;
+				}
+				/* fall through */
+			case 'F':
+				col->type = DBF_ARROW_DOUBLE;
+				col->width = 8;
+				break;
+			case 'D':
+				col->type = DBF_ARROW_DATE32;
+				col->width = 4;
+				break;
+			case 'L':
+				col->type = DBF_ARROW_BOOL;
+				break;
+			case 'I':
+				col->type = field->field_length == 4 ? DBF_ARROW_INT32 : DBF_ARROW_BINARY;
+				col->width = 4;
+				col->trim = 0;
+				break;
+			case 'B':
+				if (field->field_length == 8) {
+					col->type = DBF_ARROW_BINDOUBLE;
+					col->width = 8;
+					break;
+				}
+				/* dBASE uses B for memo fields */
+				/* fall through */
+			case 'M':
+			case 'G':
+			case 'P':
+				/* Block numbers of Visual FoxPro are 4 byte integers,
+				 * those of dBASE are stored as digits */
+				if (field->field_length == 4) {
+					col->type = DBF_ARROW_INT32;
+					col->width = 4;
+				} else {
+					col->type = DBF_ARROW_UTF8;
+				}
+				break;
+			case 'O':
+				col->type = field->field_length == 8 ? DBF_ARROW_BINDOUBLE : DBF_ARROW_BINARY;
+				col->width = 8;
+				col->trim = 0;
+				break;
+			case 'T':
+				col->type = field->field_length == 8 ? DBF_ARROW_TIMESTAMP : DBF_ARROW_BINARY;
+				col->width = 8;
+				col->trim = 0;
+				break;
+			case 'Y':
+				col->type = field->field_length == 8 ? DBF_ARROW_DECIMAL : DBF_ARROW_BINARY;
+				col->width = 16;
+				col->trim = 0;
+				break;
+			case 'C':
+			case 'V':
+				col->type = transcode ? DBF_ARROW_UTF8 : DBF_ARROW_BINARY;
+				col->transcode = transcode;
+				if (field->field_flags & DBF_FIELD_BINARY) {
+					col->type = DBF_ARROW_BINARY;
+					col->transcode = 0;
+				}
+				break;
+			case 'Q':
+			case '0':
+				col->type = DBF_ARROW_BINARY;
+				col->trim = 0;
+				break;
+			default:
+				/* Fields of unknown types may hold anything */
+				col->type = DBF_ARROW_BINARY;
+				col->trim = 0;
+				break;
+		}
+
+		if (NULL == (col->validity = malloc((batchsize + 7) / 8)))
+			goto cleanup;
+		if (col->type == DBF_ARROW_UTF8 || col->type == DBF_ARROW_BINARY) {
+			if (NULL == (col->offsets = malloc((batchsize + 1) * sizeof(int32_t))) ||
+				NULL == (col->data = malloc((size_t) batchsize * col->length * (col->transcode ? 3 : 1) + 1)))
+				goto cleanup;
+		} else if (col->type == DBF_ARROW_BOOL) {
+			if (NULL == (col->values = malloc((batchsize + 7) / 8)))
+				goto cleanup;
+		} else {
+			if (NULL == (col->values = malloc((size_t) batchsize * col->width)))
+				goto cleanup;
+		}
+	}
+
+	if (dbf_ArrowSchema(p_dbf, fd, &fb, cols) < 0)
+		goto cleanup;
+
+	if (NULL == p_dbf->mem && NULL == (buf = malloc((size_t) batchsize * reclen)))
+		goto cleanup;
+
+	for (recno = 0; recno < nrecs; recno += n) {
+		if (0 > (n = dbf_ReadBlock(p_dbf, recno, batchsize, buf, &records)))
+			goto cleanup;
+		if (n == 0)
+			break;
+
+		for (i = 0; i < (int) p_dbf->columns; i++) {
+			memset(cols[i].validity, 0, (batchsize + 7) / 8);
+			if (cols[i].type == DBF_ARROW_BOOL)
+				memset(cols[i].values, 0, (batchsize + 7) / 8);
+			if (cols[i].offsets)
+				cols[i].offsets[0] = 0;
+			cols[i].nulls = 0;
+		}
+		for (rows = 0, rec = records; rec < records + (size_t) n * reclen; rec += reclen) {
+			if ((p_dbf->scan_options & DBF_SKIP_DELETED) && rec[0] == '*')
+				continue;
+			for (i = 0; i < (int) p_dbf->columns; i++)
+				dbf_ArrowAppend(p_dbf, &cols[i], rec, rows);
+			rows++;
+		}
+		if (rows > 0 && dbf_ArrowBatch(p_dbf, fd, &fb, &body, cols, rows) < 0)
+			goto cleanup;
+		total += rows;
+	}
+
+	/* End of stream */
+	if (dbf_WriteAll(fd, "\xff\xff\xff\xff\0\0\0\0", 8) < 0)
+		goto cleanup;
+	ret = total;
+
+cleanup:
+	for (i = 0; i < (int) p_dbf->columns; i++) {
+		if (cols[i].validity)
+			free(cols[i].validity);
+		if (cols[i].values)
+			free(cols[i].values);
+		if (cols[i].offsets)
+			free(cols[i].offsets);
+		if (cols[i].data)
+			free(cols[i].data);
+	}
+	free(cols);
+	if (buf)
+		free(buf);
+	if (fb.buf)
+		free(fb.buf);
+	if (body.buf)
+		free(body.buf);
+
+	return ret;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,377 @@
+/*****************************************************************************
+ * builder.c
+ *****************************************************************************
+ * Fills the fields of records to be written to dBASE files
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/*
+ * The record passed to these functions is the record as passed to
+ * dbf_WriteRecord(), without the deletion flag, so every field starts
+ * one byte before its field_offset. Numbers are formatted from integers
+ * scaled by the number of decimals, digit by digit from the right.
+ */
+
+/* static dbf_PutField() {{{
+ * Returns the field of the column within the record or NULL if the
+ * column does not exist. The record is not changed.
+ */
+static char *dbf_PutField(P_DBF *p_dbf, char *record, int column)
+{
+	if (column < 0 || column >= (int) p_dbf->columns)
+		return NULL;
+
+	return record + p_dbf->fields[column].field_offset - 1;
+}
+/* }}} */
+
+/* static dbf_PutDone() {{{
+ * Clears the bit of the column in _NullFlags once its field has been
+ * written, i.e. if ret is 0, and returns ret. Failed calls do not write
+ * the field, so they leave the record unchanged.
+ */
+static int dbf_PutDone(P_DBF *p_dbf, char *record, int column, int ret)
+{
+	int bit;
+
+	if (ret == 0 && p_dbf->null_bits && (bit = p_dbf->null_bits[column]) >= 0)
+		record[p_dbf->nullflags - 1 + bit / 8] &= ~(1 << (bit & 7));
+
+	return ret;
+}
+/* }}} */
+
+/* static dbf_PutScaled() {{{
+ * Writes the number m / 10^dec aligned right into a numeric field.
+ * Returns -1 without writing if the number is too wide.
+ */
+static int dbf_PutScaled(char *data, int len, int dec, int64_t m)
+{
+	char buf[48], *p = buf + sizeof(buf);
+	u_int64_t u = m < 0 ? -(u_int64_t) m : (u_int64_t) m;
+	int i = 0;
+
+	do {
+		if (dec > 0 && i == dec)
+			*--p = '.';
+		*--p = '0' + u % 10;
+		u /= 10;
+		i++;
+	} while (u > 0 || (dec > 0 && i <= dec));
+	if (m < 0)
+		*--p = '-';
+
+	i = buf + sizeof(buf) - p;
+	if (i > len)
+		return -1;
+	memset(data, ' ', len - i);
+	memcpy(data + len - i, p, i);
+
+	return 0;
+}
+/* }}} */
+
+/* static dbf_Pow10() {{{
+ * Returns 10^dec for up to 18 decimals, 0 for more
+ */
+static int64_t dbf_Pow10(int dec)
+{
+	int64_t p = 1;
+
+	if (dec > 18)
+		return 0;
+	while (dec-- > 0)
+		p *= 10;
+
+	return p;
+}
+/* }}} */
+
+/* static dbf_PutText() {{{
+ * Copies text into a field, aligned left or right and padded with blanks.
+ * Text aligned right is a number, which is not cut but rejected without
+ * writing.
+ */
+static int dbf_PutText(char *data, int len, const char *s, int slen, int right)
+{
+	if (slen > len) {
+		if (right)
+			return -1;
+		slen = len;
+	}
+	if (right) {
+		memset(data, ' ', len - slen);
+		memcpy(data + len - slen, s, slen);
+	} else {
+		memcpy(data, s, slen);
+		memset(data + slen, ' ', len - slen);
+	}
+
+	return 0;
+}
+/* }}} */
+
+/* dbf_ClearRecord() {{{
+ * Sets all fields blank, binary fields to zero
+ */
+void dbf_ClearRecord(P_DBF *p_dbf, char *record)
+{
+	u_int32_t i;
+
+	memset(record, ' ', p_dbf->header->record_length - 1);
+	for (i = 0; i < p_dbf->columns; i++) {
+		switch (p_dbf->fields[i].field_type) {
+			case 'I':
+			case 'B':
+			case 'Y':
+			case 'T':
+			case '0':
+				memset(record + p_dbf->fields[i].field_offset - 1, 0, p_dbf->fields[i].field_length);
+				break;
+		}
+	}
+}
+/* }}} */
+
+/* dbf_PutInt64() {{{
+ */
+int dbf_PutInt64(P_DBF *p_dbf, char *record, int column, int64_t value)
+{
+	char *data, buf[24];
+	int len, dec, n;
+	int64_t scale;
+
+	if (NULL == (data = dbf_PutField(p_dbf, record, column)))
+		return -1;
+	len = p_dbf->fields[column].field_length;
+	dec = p_dbf->fields[column].field_decimals;
+
+	switch (p_dbf->fields[column].field_type) {
+		case 'N':
+		case 'F':
+			scale = dbf_Pow10(dec);
+			if (scale == 0 || value > DBF_INT64_MAX / scale || value < -DBF_INT64_MAX / scale)
+				return -1;
+			return dbf_PutDone(p_dbf, record, column, dbf_PutScaled(data, len, dec, value * scale));
+		case 'C':
+			n = sizeof(buf);
+			if (dbf_PutScaled(buf, n, 0, value) < 0)
+				return -1;
+			while (buf[sizeof(buf) - n] == ' ')
+				n--;
+			return dbf_PutDone(p_dbf, record, column, dbf_PutText(data, len, buf + sizeof(buf) - n, n, 0));
+		case 'I':
+			if (len != 4 || value > 2147483647LL || value < -2147483647LL - 1)
+				return -1;
+			dbf_Store32(data, (u_int32_t) value);
+			return dbf_PutDone(p_dbf, record, column, 0);
+		case 'B':
+			return dbf_PutDouble(p_dbf, record, column, (double) value);
+		case 'Y':
+			if (len != 8 || value > DBF_INT64_MAX / 10000 || value < -DBF_INT64_MAX / 10000)
+				return -1;
+			dbf_Store64(data, (u_int64_t) (value * 10000));
+			return dbf_PutDone(p_dbf, record, column, 0);
+		case 'L':
+			*data = value ? 'T' : 'F';
+			return dbf_PutDone(p_dbf, record, column, 0);
+	}
+
+	return -1;
+}
+/* }}} */
+
+/* dbf_PutDouble() {{{
+ */
+int dbf_PutDouble(P_DBF *p_dbf, char *record, int column, double value)
+{
+	char *data, buf[64];
+	int len, dec, n;
+	int64_t scale;
+	double x;
+	u_int64_t bits;
+
+	if (NULL == (data = dbf_PutField(p_dbf, record, column)))
+		return -1;
+	len = p_dbf->fields[column].field_length;
+	dec = p_dbf->fields[column].field_decimals;
+
+	switch (p_dbf->fields[column].field_type) {
+		case 'N':
+		case 'F':
+			scale = dbf_Pow10(dec);
+			x = value * scale;
+			if (scale != 0 && x < 9e18 && x > -9e18)
+				return dbf_PutDone(p_dbf, record, column,
+					dbf_PutScaled(data, len, dec, (int64_t) (x < 0 ? x - 0.5 : x + 0.5)));
+			/* Too large for the fast path, or infinite or not a number */
+			n = snprintf(buf, sizeof(buf), "%.*f", dec, value);
+			if (n < 0 || n >= (int) sizeof(buf) || value - value != 0)
+				return -1;
+			return dbf_PutDone(p_dbf, record, column, dbf_PutText(data, len, buf, n, 1));
+		case 'B':
+			/* dBASE uses B for memo fields */
+			if (len != 8)
+				return -1;
+			memcpy(&bits, &value, 8);
+			dbf_Store64(data, bits);
+			return dbf_PutDone(p_dbf, record, column, 0);
+		case 'I':
+			if (len != 4 || !(value < 2147483647.5 && value > -2147483648.5))
+				return -1;
+			dbf_Store32(data, (u_int32_t) (int32_t) (value < 0 ? value - 0.5 : value + 0.5));
+			return dbf_PutDone(p_dbf, record, column, 0);
+		case 'Y':
+			x = value * 10000;
+			if (len != 8 || !(x < 9e18 && x > -9e18))
+				return -1;
+			dbf_Store64(data, (u_int64_t) (int64_t) (x < 0 ? x - 0.5 : x + 0.5));
+			return dbf_PutDone(p_dbf, record, column, 0);
+	}
+
+	return -1;
+}
+/* }}} */
+
+/* dbf_PutDate() {{{
+ */
+int dbf_PutDate(P_DBF *p_dbf, char *record, int column, int year, int month, int day)
+{
+	char *data;
+	int32_t days;
+	int y, m, d;
+
+	if (year < 0 || year > 9999 || month < 1 || month > 12 || day < 1 || day > 31)
+		return -1;
+	/* Days beyond the end of the month, like February 31st, would end up
+	 * in the next month
+	 */
+	days = dbf_DaysFromCivil(year, month, day);
+	dbf_CivilFromDays(days, &y, &m, &d);
+	if (d != day)
+		return -1;
+	if (NULL == (data = dbf_PutField(p_dbf, record, column)))
+		return -1;
+
+	switch (p_dbf->fields[column].field_type) {
+		case 'D':
+			if (p_dbf->fields[column].field_length != 8)
+				return -1;
+			data[0] = '0' + year / 1000;
+			data[1] = '0' + year / 100 % 10;
+			data[2] = '0' + year / 10 % 10;
+			data[3] = '0' + year % 10;
+			data[4] = '0' + month / 10;
+			data[5] = '0' + month % 10;
+			data[6] = '0' + day / 10;
+			data[7] = '0' + day % 10;
+			return dbf_PutDone(p_dbf, record, column, 0);
+		case 'T':
+			if (p_dbf->fields[column].field_length != 8)
+				return -1;
+			dbf_Store32(data, (u_int32_t) (days + DBF_JULIAN_EPOCH));
+			dbf_Store32(data + 4, 0);
+			return dbf_PutDone(p_dbf, record, column, 0);
+	}
+
+	return -1;
+}
+/* }}} */
+
+/* dbf_PutBool() {{{
+ */
+int dbf_PutBool(P_DBF *p_dbf, char *record, int column, int value)
+{
+	char *data;
+
+	if (NULL == (data = dbf_PutField(p_dbf, record, column)))
+		return -1;
+	if (p_dbf->fields[column].field_type != 'L')
+		return -1;
+	*data = value ? 'T' : 'F';
+
+	return dbf_PutDone(p_dbf, record, column, 0);
+}
+/* }}} */
+
+/* dbf_PutString() {{{
+ */
+int dbf_PutString(P_DBF *p_dbf, char *record, int column, const char *value, int len)
+{
+	char *data;
+
+	if (NULL == (data = dbf_PutField(p_dbf, record, column)))
+		return -1;
+	if (len < 0)
+		len = strlen(value);
+
+	switch (p_dbf->fields[column].field_type) {
+		case 'I':
+		case 'B':
+		case 'Y':
+		case 'T':
+		case '0':
+			return -1;
+	}
+
+	switch (p_dbf->fields[column].field_type) {
+		case 'N':
+		case 'F':
+			return dbf_PutDone(p_dbf, record, column,
+				dbf_PutText(data, p_dbf->fields[column].field_length, value, len, 1));
+	}
+
+	return dbf_PutDone(p_dbf, record, column,
+		dbf_PutText(data, p_dbf->fields[column].field_length, value, len, 0));
+}
+/* }}} */
+
+/* dbf_PutNull() {{{
+ * Sets a field blank and its bit in _NullFlags if the column can be null
+ */
+int dbf_PutNull(P_DBF *p_dbf, char *record, int column)
+{
+	char *data;
+	int bit;
+
+	if (NULL == (data = dbf_PutField(p_dbf, record, column)))
+		return -1;
+
+	switch (p_dbf->fields[column].field_type) {
+		case 'I':
+		case 'B':
+		case 'Y':
+		case 'T':
+			memset(data, 0, p_dbf->fields[column].field_length);
+			break;
+		default:
+			memset(data, ' ', p_dbf->fields[column].field_length);
+			break;
+	}
+	if (p_dbf->null_bits && (bit = p_dbf->null_bits[column]) >= 0)
+		record[p_dbf->nullflags - 1 + bit / 8] |= 1 << (bit & 7);
+
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,289 @@
+/*****************************************************************************
+ * cache.c
+ *****************************************************************************
+ * Page cache for updating records of dBASE files
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include <sys/uio.h>
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/*
+ * Updated records are collected in pages of DBF_PAGE_SIZE bytes. Pages
+ * are not read from the file, each page only holds the bytes which have
+ * been modified and marks them in a bitmap, so records appended or
+ * changed by other processes meanwhile are never overwritten. The pages
+ * are written back when they are evicted from their slot or when the
+ * cache is flushed, in which case the modified bytes of adjacent pages
+ * are combined into as few writes as possible.
+ */
+
+/* iovecs written with one system call */
+#define DBF_CACHE_IOV 64
+
+/* static dbf_CacheRun() {{{
+ * Returns the first position from pos up to end whose byte is modified
+ * if dirty is set, or unmodified if not, or end if there is none
+ */
+static size_t dbf_CacheRun(const DBF_PAGE *page, size_t pos, size_t end, int dirty)
+{
+	for (; pos < end; pos++) {
+		/* whole bytes of the bitmap at once */
+		if ((pos & 7) == 0 && pos + 8 <= end &&
+			page->dirty[pos / 8] == (dirty ? 0x00 : 0xFF)) {
+			pos += 7;
+			continue;
+		}
+		if (((page->dirty[pos / 8] >> (pos & 7)) & 1) == dirty)
+			break;
+	}
+
+	return pos;
+}
+/* }}} */
+
+/* static dbf_CacheWriteV() {{{
+ * Writes count buffers of len bytes in total at offset without moving
+ * the file position, which other threads may use meanwhile
+ */
+static int dbf_CacheWriteV(P_DBF *p_dbf, struct iovec *iov, int count, off_t offset, ssize_t len)
+{
+#ifdef HAVE_PWRITEV
+	return pwritev(p_dbf->dbf_fh, iov, count, offset) == len ? 0 : -1;
+#else
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (dbf_WriteAt(p_dbf, iov[i].iov_base, iov[i].iov_len, offset) != (ssize_t) iov[i].iov_len)
+			return -1;
+		offset += iov[i].iov_len;
+	}
+	return 0;
+#endif
+}
+/* }}} */
+
+/* static dbf_CacheWriteBack() {{{
+ * Writes the modified bytes of count pages, which are sorted by their
+ * position in the file. Runs of modified bytes that continue on the next
+ * page are written with one system call.
+ */
+static int dbf_CacheWriteBack(P_DBF *p_dbf, DBF_PAGE **pages, int count)
+{
+	struct iovec iov[DBF_CACHE_IOV];
+	off_t offset = 0, next = -1, at;
+	ssize_t len = 0;
+	size_t pos, end;
+	int i, n = 0;
+
+	for (i = 0; i < count; i++) {
+		for (pos = pages[i]->dirty_start; pos < pages[i]->dirty_end; pos = end) {
+			pos = dbf_CacheRun(pages[i], pos, pages[i]->dirty_end, 1);
+			if (pos == pages[i]->dirty_end)
+				break;
+			end = dbf_CacheRun(pages[i], pos, pages[i]->dirty_end, 0);
+			at = pages[i]->page * DBF_PAGE_SIZE + pos;
+
+			if (n > 0 && (at != next || n == DBF_CACHE_IOV)) {
+				if (0 > dbf_CacheWriteV(p_dbf, iov, n, offset, len))
+					return -1;
+				n = 0;
+			}
+			if (n == 0) {
+				offset = at;
+				len = 0;
+			}
+			iov[n].iov_base = pages[i]->data + pos;
+			iov[n].iov_len = end - pos;
+			len += end - pos;
+			n++;
+			next = at + (end - pos);
+		}
+	}
+	if (n > 0 && 0 > dbf_CacheWriteV(p_dbf, iov, n, offset, len))
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		memset(pages[i]->dirty, 0, DBF_PAGE_SIZE / 8);
+		pages[i]->dirty_start = pages[i]->dirty_end = 0;
+	}
+
+	return 0;
+}
+/* }}} */
+
+/* static dbf_CacheComparePages() {{{
+ */
+static int dbf_CacheComparePages(const void *a, const void *b)
+{
+	const DBF_PAGE *pa = *(const DBF_PAGE **) a;
+	const DBF_PAGE *pb = *(const DBF_PAGE **) b;
+
+	if (pa->page < pb->page)
+		return -1;
+	return pa->page > pb->page;
+}
+/* }}} */
+
+/* dbf_CacheWrite() {{{
+ * Copies len bytes into the cached pages starting at offset and marks
+ * them as modified. Returns the number of bytes written or -1 on error.
+ */
+ssize_t dbf_CacheWrite(P_DBF *p_dbf, const void *buf, size_t len, off_t offset)
+{
+	const unsigned char *src = buf;
+	DBF_PAGE *page;
+	off_t pageno;
+	size_t pos, n, i;
+
+	if (NULL == p_dbf->pages) {
+		if (NULL == (p_dbf->pages = calloc(DBF_CACHE_PAGES, sizeof(DBF_PAGE))))
+			return -1;
+		for (n = 0; n < DBF_CACHE_PAGES; n++)
+			p_dbf->pages[n].page = -1;
+	}
+
+	while (len > 0) {
+		pageno = offset / DBF_PAGE_SIZE;
+		pos = offset % DBF_PAGE_SIZE;
+		n = DBF_PAGE_SIZE - pos;
+		if (n > len)
+			n = len;
+
+		page = &p_dbf->pages[pageno % DBF_CACHE_PAGES];
+		if (page->page != pageno) {
+			if (page->dirty_end > page->dirty_start &&
+				0 > dbf_CacheWriteBack(p_dbf, &page, 1))
+				return -1;
+			if (NULL == page->data) {
+				if (NULL == (page->data = malloc(DBF_PAGE_SIZE + DBF_PAGE_SIZE / 8)))
+					return -1;
+				page->dirty = page->data + DBF_PAGE_SIZE;
+				memset(page->dirty, 0, DBF_PAGE_SIZE / 8);
+			}
+			page->page = pageno;
+		}
+
+		memcpy(page->data + pos, src, n);
+		for (i = pos; i < pos + n; i++)
+			page->dirty[i / 8] |= 1 << (i & 7);
+		if (page->dirty_end == page->dirty_start) {
+			page->dirty_start = pos;
+			page->dirty_end = pos + n;
+		} else {
+			if (pos < page->dirty_start)
+				page->dirty_start = pos;
+			if (pos + n > page->dirty_end)
+				page->dirty_end = pos + n;
+		}
+
+		src += n;
+		offset += n;
+		len -= n;
+	}
+
+	return src - (const unsigned char *) buf;
+}
+/* }}} */
+
+/* dbf_CacheOverlay() {{{
+ * Copies the modified bytes of all cached pages within the len bytes
+ * starting at offset into buf, which has just been read from the file.
+ */
+void dbf_CacheOverlay(P_DBF *p_dbf, void *buf, size_t len, off_t offset)
+{
+	DBF_PAGE *page;
+	off_t pageno, base;
+	size_t pos, end, stop;
+
+	if (NULL == p_dbf->pages || len == 0)
+		return;
+
+	for (pageno = offset / DBF_PAGE_SIZE; pageno * DBF_PAGE_SIZE < offset + (off_t) len; pageno++) {
+		page = &p_dbf->pages[pageno % DBF_CACHE_PAGES];
+		if (page->page != pageno || page->dirty_end == page->dirty_start)
+			continue;
+		base = pageno * DBF_PAGE_SIZE;
+		pos = page->dirty_start;
+		stop = page->dirty_end;
+		if (base + (off_t) pos < offset)
+			pos = offset - base;
+		if (base + (off_t) stop > offset + (off_t) len)
+			stop = offset + len - base;
+		for (; pos < stop; pos = end) {
+			pos = dbf_CacheRun(page, pos, stop, 1);
+			end = dbf_CacheRun(page, pos, stop, 0);
+			memcpy((char *) buf + (base + pos - offset), page->data + pos, end - pos);
+		}
+	}
+}
+/* }}} */
+
+/* dbf_CacheFree() {{{
+ * Frees all pages without writing them back
+ */
+void dbf_CacheFree(P_DBF *p_dbf)
+{
+	int i;
+
+	if (NULL == p_dbf->pages)
+		return;
+
+	for (i = 0; i < DBF_CACHE_PAGES; i++) {
+		if (p_dbf->pages[i].data)
+			free(p_dbf->pages[i].data);
+	}
+	free(p_dbf->pages);
+	p_dbf->pages = NULL;
+}
+/* }}} */
+
+/* dbf_Flush() {{{
+ * Writes all modified pages back into the file
+ */
+int dbf_Flush(P_DBF *p_dbf)
+{
+	DBF_PAGE *dirty[DBF_CACHE_PAGES];
+	int i, count = 0;
+
+	if (NULL == p_dbf->pages)
+		return 0;
+
+	for (i = 0; i < DBF_CACHE_PAGES; i++) {
+		if (p_dbf->pages[i].page != -1 &&
+			p_dbf->pages[i].dirty_end > p_dbf->pages[i].dirty_start)
+			dirty[count++] = &p_dbf->pages[i];
+	}
+	if (count == 0)
+		return 0;
+
+	qsort(dirty, count, sizeof(DBF_PAGE *), dbf_CacheComparePages);
+	if (0 > dbf_CacheWriteBack(p_dbf, dirty, count))
+		return -1;
+
+	/* Record the date of the modification */
+	if (0 > dbf_WriteHeaderShared(p_dbf))
+		return -1;
+
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -21,6 +21,26 @@
 #include "../include/libdbf/libdbf.h"
 #include "dbf.h"
 
+/* Number of bits set in a byte, used for counting bitmaps */
+static const unsigned char dbf_popcount[256] = {
+	0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+	3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+	3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+	3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+	3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+	4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8
+};
+
 /* get_db_version() {{{
  * Convert version field of header into human readable string.
  */
@@ -47,6 +67,10 @@ const char *get_db_version(int version) {
 		case 0x30:
 			// without memo fields
 			return "Visual FoxPro";
+		case 0x31:
+			return "Visual FoxPro, autoincrement enabled";
+		case 0x32:
+			return "Visual FoxPro, varchar/varbinary enabled";
 		case 0xF5:
 			// with memo fields
 			return "FoxPro 2.0";
@@ -57,6 +81,131 @@ const char *get_db_version(int version) {
 }
 /* }}} */
 
+/* static dbf_ReadStream() {{{
+ * Reads len bytes starting at offset from a pipe. The bytes up to offset
+ * are skipped, those before the current position are gone. Short reads
+ * are repeated until len bytes are read or the input ends. Returns the
+ * number of bytes read or -1 on error.
+ */
+static ssize_t dbf_ReadStream(P_DBF *p_dbf, void *buf, size_t len, off_t offset)
+{
+	char skip[4096];
+	size_t done = 0;
+	ssize_t n;
+
+	if (offset < p_dbf->stream_pos)
+		return -1;
+	while (p_dbf->stream_pos < offset) {
+		n = offset - p_dbf->stream_pos > (off_t) sizeof(skip) ? (ssize_t) sizeof(skip) : offset - p_dbf->stream_pos;
+		if ((n = read(p_dbf->dbf_fh, skip, n)) == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return n;
+		p_dbf->stream_pos += n;
+	}
+	while (done < len) {
+		if ((n = read(p_dbf->dbf_fh, (char *) buf + done, len - done)) == -1 && errno == EINTR)
+			continue;
+		if (n == -1)
+			return -1;
+		if (n == 0)
+			break;
+		done += n;
+		p_dbf->stream_pos += n;
+	}
+
+	return done;
+}
+/* }}} */
+
+/* dbf_ReadAt() {{{
+ * Reads len bytes starting at offset from the table. Tables opened with
+ * dbf_OpenMemory() are served from the memory buffer, all others from the
+ * file handle. Returns the number of bytes read or -1 on error.
+ */
+ssize_t dbf_ReadAt(P_DBF *p_dbf, void *buf, size_t len, off_t offset)
+{
+	ssize_t n;
+
+	if (p_dbf->mem) {
+		if (offset < 0)
+			return -1;
+		if ((size_t) offset >= p_dbf->mem_len)
+			return 0;
+		if (len > p_dbf->mem_len - offset)
+			len = p_dbf->mem_len - offset;
+		memcpy(buf, p_dbf->mem + offset, len);
+		return len;
+	}
+
+	if (p_dbf->stream_pos >= 0) {
+		n = dbf_ReadStream(p_dbf, buf, len, offset);
+	} else {
+#ifdef HAVE_PREAD
+		/* pread() leaves the file position alone, so blocks of the same
+		 * file can be read by several threads at once
+		 */
+		n = pread(p_dbf->dbf_fh, buf, len, offset);
+#else
+		lseek(p_dbf->dbf_fh, offset, SEEK_SET);
+		n = read(p_dbf->dbf_fh, buf, len);
+#endif
+	}
+	if (n == -1)
+		return -1;
+	/* Records updated but not yet written back */
+	dbf_CacheOverlay(p_dbf, buf, n, offset);
+	return n;
+}
+/* }}} */
+
+/* dbf_WriteAt() {{{
+ * Writes len bytes starting at offset into the table. The buffer of
+ * tables created with dbf_CreateMemory() grows geometrically as needed.
+ * Returns the number of bytes written or -1 on error.
+ */
+ssize_t dbf_WriteAt(P_DBF *p_dbf, const void *buf, size_t len, off_t offset)
+{
+	if (p_dbf->mem_alloc) {
+		size_t end, size;
+		unsigned char *mem;
+
+		if (offset < 0)
+			return -1;
+		end = offset + len;
+		if (end > p_dbf->mem_size) {
+			size = p_dbf->mem_size;
+			while (size < end)
+				size *= 2;
+			if (NULL == (mem = realloc(p_dbf->mem_alloc, size)))
+				return -1;
+			p_dbf->mem_alloc = mem;
+			p_dbf->mem_size = size;
+			p_dbf->mem = mem;
+		}
+		if ((size_t) offset > p_dbf->mem_len)
+			memset(p_dbf->mem_alloc + p_dbf->mem_len, 0, offset - p_dbf->mem_len);
+		memcpy(p_dbf->mem_alloc + offset, buf, len);
+		if (end > p_dbf->mem_len)
+			p_dbf->mem_len = end;
+		return len;
+	}
+
+#ifdef HAVE_PWRITE
+	{
+		ssize_t n;
+
+		if ((n = pwrite(p_dbf->dbf_fh, buf, len, offset)) == -1 && errno == ESPIPE)
+			n = write(p_dbf->dbf_fh, buf, len);
+		return n;
+	}
+#else
+	lseek(p_dbf->dbf_fh, offset, SEEK_SET);
+	return write(p_dbf->dbf_fh, buf, len);
+#endif
+}
+/* }}} */
+
 /* static dbf_ReadHeaderInfo() {{{
  * Reads header from file into struct
  */
@@ -66,24 +215,37 @@ static int dbf_ReadHeaderInfo(P_DBF *p_dbf)
 	if(NULL == (header = malloc(sizeof(DB_HEADER)))) {
 		return -1;
 	}
-	if ((read( p_dbf->dbf_fh, header, sizeof(DB_HEADER))) == -1 ) {
+	if ((dbf_ReadAt(p_dbf, header, sizeof(DB_HEADER), 0)) != sizeof(DB_HEADER) ) {
+		free(header);
 		return -1;
 	}
 
 	/* Endian Swapping */
-	header->header_length = rotate2b(header->header_length);
-	header->record_length = rotate2b(header->record_length);
-	header->records = rotate4b(header->records);
+	header->header_length = dbf_LE16(header->header_length);
+	header->record_length = dbf_LE16(header->record_length);
+	header->records = dbf_LE32(header->records);
 	p_dbf->header = header;
 
+	/* The lengths are used for allocations and reads without further
+	 * checks, so tables which cannot hold a single field are rejected
+	 * here instead of in every function reading records.
+	 */
+	if (header->header_length <= sizeof(DB_HEADER) || header->record_length < 2 ||
+		dbf_NumCols(p_dbf) < 1 ||
+		(p_dbf->mem && header->header_length > p_dbf->mem_len)) {
+		p_dbf->header = NULL;
+		free(header);
+		return -1;
+	}
+
 	return 0;
 }
 /* }}} */
 
-/* static dbf_WriteHeaderInfo() {{{
+/* dbf_WriteHeaderInfo() {{{
  * Write header into file
  */
-static int dbf_WriteHeaderInfo(P_DBF *p_dbf, DB_HEADER *header)
+int dbf_WriteHeaderInfo(P_DBF *p_dbf, DB_HEADER *header)
 {
 	time_t ps_calendar_time;
 	struct tm *ps_local_tm;
@@ -102,16 +264,15 @@ static int dbf_WriteHeaderInfo(P_DBF *p_dbf, DB_HEADER *header)
 		newheader->last_update[2] = ps_local_tm->tm_mday;
 	}
 
-	newheader->header_length = rotate2b(newheader->header_length);
-	newheader->record_length = rotate2b(newheader->record_length);
-	newheader->records = rotate4b(newheader->records);
+	newheader->header_length = dbf_LE16(newheader->header_length);
+	newheader->record_length = dbf_LE16(newheader->record_length);
+	newheader->records = dbf_LE32(newheader->records);
 
 	/* Make sure the header is written at the beginning of the file
 	 * because this function is also called after each record has
 	 * been written.
 	 */
-	lseek(p_dbf->dbf_fh, 0, SEEK_SET);
-	if ((write( p_dbf->dbf_fh, newheader, sizeof(DB_HEADER))) == -1 ) {
+	if ((dbf_WriteAt(p_dbf, newheader, sizeof(DB_HEADER), 0)) == -1 ) {
 		free(newheader);
 		return -1;
 	}
@@ -120,6 +281,33 @@ static int dbf_WriteHeaderInfo(P_DBF *p_dbf, DB_HEADER *header)
 }
 /* }}} */
 
+/* static dbf_CheckFieldWidth() {{{
+ * Binary fields are loaded and stored with their fixed widths without
+ * further checks, so fields of other widths are rejected
+ */
+static int dbf_CheckFieldWidth(P_DBF *p_dbf, DB_FIELD *field)
+{
+	switch (field->field_type) {
+		case 'I':
+			return field->field_length == 4 ? 0 : -1;
+		case 'Y':
+		case 'T':
+			return field->field_length == 8 ? 0 : -1;
+		case 'B':
+			/* dBASE uses B for memo fields */
+			switch (p_dbf->header->version) {
+				case VisualFoxPro:
+				case VisualFoxProAI:
+				case VisualFoxProVar:
+					return field->field_length == 8 ? 0 : -1;
+			}
+			break;
+	}
+
+	return 0;
+}
+/* }}} */
+
 /* static dbf_ReadFieldInfo() {{{
  * Sets p_dbf->fields to an array of DB_FIELD containing the specification
  * for all columns.
@@ -135,22 +323,62 @@ static int dbf_ReadFieldInfo(P_DBF *p_dbf)
 		return -1;
 	}
 
-	lseek(p_dbf->dbf_fh, sizeof(DB_HEADER), SEEK_SET);
-
-	if ((read( p_dbf->dbf_fh, fields, columns * sizeof(DB_FIELD))) == -1 ) {
+	if ((dbf_ReadAt(p_dbf, fields, columns * sizeof(DB_FIELD), sizeof(DB_HEADER))) !=
+		(ssize_t) (columns * sizeof(DB_FIELD)) ) {
 		perror(_("In function dbf_ReadFieldInfo(): "));
+		free(fields);
+		return -1;
+	}
+	/* Some writers pad the header, the field descriptors end at the
+	 * terminator
+	 */
+	for(i = 0; i < columns; i++) {
+		if (fields[i].field_name[0] == '\r')
+			break;
+	}
+	if (i == 0) {
+		free(fields);
 		return -1;
 	}
+	columns = i;
 	p_dbf->fields = fields;
 	p_dbf->columns = columns;
 	/* The first byte of a record indicates whether it is deleted or not. */
 	offset = 1;
 	for(i = 0; i < columns; i++) {
+		if (0 > dbf_CheckFieldWidth(p_dbf, &fields[i]))
+			return -1;
 		fields[i].field_offset = offset;
 		offset += fields[i].field_length;
+		if (fields[i].field_type == '0' && (fields[i].field_flags & DBF_FIELD_SYSTEM))
+			p_dbf->nullflags = fields[i].field_offset;
+	}
+	/* Fields reaching beyond the record would be read from the next one */
+	if (offset > p_dbf->header->record_length) {
+		return -1;
 	}
 
-	return 0;
+	if (p_dbf->nullflags) {
+		int bit = 0;
+
+		if(NULL == (p_dbf->null_bits = malloc(columns * sizeof(int)))) {
+			return -1;
+		}
+		/* Visual FoxPro numbers the varchar and nullable fields in order,
+		 * varchar fields use one bit for their length before the null bit.
+		 */
+		for(i = 0; i < columns; i++) {
+			if (fields[i].field_type == 'V' || fields[i].field_type == 'Q')
+				bit++;
+			p_dbf->null_bits[i] = (fields[i].field_flags & DBF_FIELD_NULLABLE) ? bit++ : -1;
+		}
+		for(i = 0; i < columns; i++) {
+			if (fields[i].field_offset == p_dbf->nullflags && bit > 8 * fields[i].field_length)
+				return -1;
+		}
+	}
+
+	return dbf_BuildPlan(p_dbf);
 }
 /* }}} */
 
@@ -159,46 +387,86 @@ static int dbf_ReadFieldInfo(P_DBF *p_dbf)
  */
 static int dbf_WriteFieldInfo(P_DBF *p_dbf, DB_FIELD *fields, int numfields)
 {
-	lseek(p_dbf->dbf_fh, sizeof(DB_HEADER), SEEK_SET);
-
-	if ((write( p_dbf->dbf_fh, fields, numfields * sizeof(DB_FIELD))) == -1 ) {
+	if ((dbf_WriteAt(p_dbf, fields, numfields * sizeof(DB_FIELD), sizeof(DB_HEADER))) == -1 ) {
 		perror(_("In function dbf_WriteFieldInfo(): "));
 		return -1;
 	}
 
-	write(p_dbf->dbf_fh, "\r\0", 2);
+	dbf_WriteAt(p_dbf, "\r\0", 2, sizeof(DB_HEADER) + numfields * sizeof(DB_FIELD));
 
 	return 0;
 }
 /* }}} */
 
+/* static dbf_NewHandle() {{{
+ * Allocates a new file handler with all members cleared
+ */
+static P_DBF *dbf_NewHandle(void)
+{
+	P_DBF *p_dbf;
+
+	if(NULL == (p_dbf = calloc(1, sizeof(P_DBF)))) {
+		return NULL;
+	}
+	p_dbf->dbf_fh = -1;
+	p_dbf->dbt_fh = -1;
+	p_dbf->stream_pos = -1;
+
+	return p_dbf;
+}
+/* }}} */
+
 /* dbf_Open() {{{
  * Open the a dbf file and returns file handler
  */
 P_DBF *dbf_Open(const char *file)
+{
+	return dbf_OpenEx(file, 0);
+}
+/* }}} */
+
+/* dbf_OpenEx() {{{
+ * Open the a dbf file with the given flags and returns file handler
+ */
+P_DBF *dbf_OpenEx(const char *file, int flags)
 {
 	P_DBF *p_dbf;
-	if(NULL == (p_dbf = malloc(sizeof(P_DBF)))) {
+	if(NULL == (p_dbf = dbf_NewHandle())) {
 		return NULL;
 	}
 
+	p_dbf->open_flags = flags;
 	if (file[0] == '-' && file[1] == '\0') {
 		p_dbf->dbf_fh = fileno(stdin);
-	} else if ((p_dbf->dbf_fh = open(file, O_RDONLY|O_BINARY)) == -1) {
+	} else if ((p_dbf->dbf_fh = open(file, ((flags & DBF_OPEN_RDWR) ? O_RDWR : O_RDONLY)|O_BINARY)) == -1) {
 		free(p_dbf);
 		return NULL;
+	} else if (NULL == (p_dbf->filename = strdup(file))) {
+		close(p_dbf->dbf_fh);
+		free(p_dbf);
+		return NULL;
+	}
+	/* Pipes cannot seek and are read in order */
+	if (lseek(p_dbf->dbf_fh, 0, SEEK_CUR) == -1 && errno == ESPIPE) {
+		p_dbf->stream_pos = 0;
 	}
 
 	p_dbf->header = NULL;
 	if(0 > dbf_ReadHeaderInfo(p_dbf)) {
-		free(p_dbf);
+		dbf_Close(p_dbf);
+		return NULL;
+	}
+
+	/* Reject truncated files before anything else is read */
+	if((flags & DBF_OPEN_CHECKSIZE) && dbf_CheckSize(p_dbf) > 0 &&
+		p_dbf->real_filesize < p_dbf->calc_filesize) {
+		dbf_Close(p_dbf);
 		return NULL;
 	}
 
 	p_dbf->fields = NULL;
 	if(0 > dbf_ReadFieldInfo(p_dbf)) {
-		free(p_dbf->header);
-		free(p_dbf);
+		dbf_Close(p_dbf);
 		return NULL;
 	}
 
@@ -208,22 +476,54 @@ P_DBF *dbf_Open(const char *file)
 }
 /* }}} */
 
-/* dbf_CreateFH() {{{
- * Create a new dbf file and returns file handler
+/* dbf_OpenMemory() {{{
+ * Open a dbf file which is already completely in memory and returns
+ * file handler. The buffer is not copied and must stay valid until
+ * the table is closed.
  */
-P_DBF *dbf_CreateFH(int fh, DB_FIELD *fields, int numfields)
+P_DBF *dbf_OpenMemory(const void *buf, size_t len)
 {
 	P_DBF *p_dbf;
-	DB_HEADER *header;
-	int reclen, i;
 
-	if(NULL == (p_dbf = malloc(sizeof(P_DBF)))) {
+	if (NULL == buf || len < sizeof(DB_HEADER)) {
+		return NULL;
+	}
+	if(NULL == (p_dbf = dbf_NewHandle())) {
 		return NULL;
 	}
 
-	p_dbf->dbf_fh = fh;
+	p_dbf->mem = buf;
+	p_dbf->mem_len = len;
+
+	p_dbf->header = NULL;
+	if(0 > dbf_ReadHeaderInfo(p_dbf)) {
+		free(p_dbf);
+		return NULL;
+	}
+
+	p_dbf->fields = NULL;
+	if(0 > dbf_ReadFieldInfo(p_dbf)) {
+		dbf_Close(p_dbf);
+		return NULL;
+	}
+
+	p_dbf->cur_record = 0;
+
+	return p_dbf;
+}
+/* }}} */
+
+/* static dbf_CreateTable() {{{
+ * Writes header and field specification of a new table into the file
+ * or memory buffer already set up in p_dbf. Frees p_dbf on error.
+ */
+static P_DBF *dbf_CreateTable(P_DBF *p_dbf, DB_FIELD *fields, int numfields)
+{
+	DB_HEADER *header;
+	int reclen, i, offset;
 
 	if(NULL == (header = malloc(sizeof(DB_HEADER)))) {
+		free(p_dbf);
 		return NULL;
 	}
 	reclen = 0;
@@ -236,6 +536,7 @@ P_DBF *dbf_CreateFH(int fh, DB_FIELD *fields, int numfields)
 	header->record_length = reclen+1;
 	header->header_length = sizeof(DB_HEADER) + numfields * sizeof(DB_FIELD) + 2;
 	if(0 > dbf_WriteHeaderInfo(p_dbf, header)) {
+		free(header);
 		free(p_dbf);
 		return NULL;
 	}
@@ -247,6 +548,18 @@ P_DBF *dbf_CreateFH(int fh, DB_FIELD *fields, int numfields)
 		return NULL;
 	}
 	p_dbf->fields = fields;
+	p_dbf->columns = numfields;
+	/* The first byte of a record indicates whether it is deleted or not. */
+	offset = 1;
+	for(i = 0; i < numfields; i++) {
+		fields[i].field_offset = offset;
+		offset += fields[i].field_length;
+	}
+	if(0 > dbf_BuildPlan(p_dbf)) {
+		free(p_dbf->header);
+		free(p_dbf);
+		return NULL;
+	}
 
 	p_dbf->cur_record = 0;
 
@@ -254,6 +567,58 @@ P_DBF *dbf_CreateFH(int fh, DB_FIELD *fields, int numfields)
 }
 /* }}} */
 
+/* dbf_CreateFH() {{{
+ * Create a new dbf file and returns file handler
+ */
+P_DBF *dbf_CreateFH(int fh, DB_FIELD *fields, int numfields)
+{
+	P_DBF *p_dbf;
+
+	if(NULL == (p_dbf = dbf_NewHandle())) {
+		return NULL;
+	}
+
+	p_dbf->dbf_fh = fh;
+
+	return(dbf_CreateTable(p_dbf, fields, numfields));
+}
+/* }}} */
+
+/* dbf_CreateMemory() {{{
+ * Create a new dbf file in a growable memory buffer and returns file handler
+ */
+P_DBF *dbf_CreateMemory(DB_FIELD *fields, int numfields)
+{
+	P_DBF *p_dbf;
+	unsigned char *mem;
+	size_t size;
+
+	if(NULL == (p_dbf = dbf_NewHandle())) {
+		return NULL;
+	}
+
+	/* Start with room for the header and a couple of records */
+	size = 4096;
+	while (size < sizeof(DB_HEADER) + numfields * sizeof(DB_FIELD) + 2)
+		size *= 2;
+	if(NULL == (mem = malloc(size))) {
+		free(p_dbf);
+		return NULL;
+	}
+
+	p_dbf->mem = mem;
+	p_dbf->mem_alloc = mem;
+	p_dbf->mem_size = size;
+
+	if(NULL == (p_dbf = dbf_CreateTable(p_dbf, fields, numfields))) {
+		free(mem);
+		return NULL;
+	}
+
+	return p_dbf;
+}
+/* }}} */
+
 /* dbf_Create() {{{
  * Create a new dbf file and returns file handler
  */
@@ -276,14 +641,42 @@ P_DBF *dbf_Create(const char *file, DB_FIELD *fields, int numfields)
  */
 int dbf_Close(P_DBF *p_dbf)
 {
+	int ret = 0;
+
+	if(p_dbf->pages) {
+		ret = dbf_Flush(p_dbf);
+		dbf_CacheFree(p_dbf);
+	}
+
 	if(p_dbf->header)
 		free(p_dbf->header);
 
 	if(p_dbf->fields)
 		free(p_dbf->fields);
 
-	if ( p_dbf->dbf_fh == fileno(stdin) )
+	if(p_dbf->filename)
+		free(p_dbf->filename);
+
+	if(p_dbf->utf8)
+		free(p_dbf->utf8);
+
+	if(p_dbf->null_bits)
+		free(p_dbf->null_bits);
+
+	if(p_dbf->plan)
+		free(p_dbf->plan);
+
+	if ( p_dbf->mem ) {
+		if ( p_dbf->mem_alloc )
+			free(p_dbf->mem_alloc);
+		free(p_dbf);
 		return 0;
+	}
+
+	if ( p_dbf->dbf_fh == fileno(stdin) ) {
+		free(p_dbf);
+		return ret;
+	}
 
 	if( (close(p_dbf->dbf_fh)) == -1 ) {
 		return -1;
@@ -291,7 +684,32 @@ int dbf_Close(P_DBF *p_dbf)
 
 	free(p_dbf);
 
-	return 0;
+	return ret;
+}
+/* }}} */
+
+/* dbf_CloseMemory() {{{
+ * Close a dbf file created in memory and pass the buffer to the caller
+ */
+int dbf_CloseMemory(P_DBF *p_dbf, void **buf, size_t *len)
+{
+	if ( NULL == p_dbf->mem_alloc ) {
+		return -1;
+	}
+
+	/* The header is only written once for memory buffers */
+	if ( 0 > dbf_WriteHeaderInfo(p_dbf, p_dbf->header) ) {
+		return -1;
+	}
+
+	if ( buf ) {
+		*buf = p_dbf->mem_alloc;
+		p_dbf->mem_alloc = NULL;
+	}
+	if ( len )
+		*len = p_dbf->mem_len;
+
+	return dbf_Close(p_dbf);
 }
 /* }}} */
 
@@ -306,14 +724,8 @@ int dbf_Close(P_DBF *p_dbf)
  */
 int dbf_NumRows(P_DBF *p_dbf)
 {
-	if ( p_dbf->header->records > 0 ) {
-		return p_dbf->header->records;
-	} else {
-		perror(_("In function dbf_NumRows(): "));
-		return -1;
-	}
-
-	return 0;
+	/* Empty tables have no rows, which is no error */
+	return p_dbf->header->records;
 }
 /* }}} */
 
@@ -323,8 +735,20 @@ int dbf_NumRows(P_DBF *p_dbf)
 int dbf_NumCols(P_DBF *p_dbf)
 {
 	if ( p_dbf->header->header_length > 0) {
-		// TODO: Backlink muss noch eingerechnet werden
-		return ((p_dbf->header->header_length - sizeof(DB_HEADER) -1)
+		int backlink = 0;
+
+		/* Visual FoxPro stores the path of the database container
+		 * behind the field descriptors */
+		switch (p_dbf->header->version) {
+			case VisualFoxPro:
+			case VisualFoxProAI:
+			case VisualFoxProVar:
+				backlink = 263;
+				break;
+		}
+		if (p_dbf->header->header_length < sizeof(DB_HEADER) + 1 + backlink)
+			return 0;
+		return ((p_dbf->header->header_length - sizeof(DB_HEADER) - 1 - backlink)
 					 / sizeof(DB_FIELD));
 	} else {
 		perror(_("In function dbf_NumCols(): "));
@@ -425,7 +849,8 @@ int dbf_SetField(DB_FIELD *field, int type, const char *name, int len, int dec)
  */
 const char *dbf_GetDate(P_DBF *p_dbf)
 {
-	static char date[10];
+	/* Room for the terminator and day or month numbers above 99 */
+	static char date[16];
 
 	if ( p_dbf->header->last_update[0] ) {
 		sprintf(date, "%d-%02d-%02d",
@@ -538,38 +963,239 @@ int dbf_SetRecordOffset(P_DBF *p_dbf, int offset) {
 }
 /* }}} */
 
-/* dbf_ReadRecord() {{{
+/* dbf_SetScanOptions() {{{
  */
-int dbf_ReadRecord(P_DBF *p_dbf, char *record, int len) {
+int dbf_SetScanOptions(P_DBF *p_dbf, int options) {
+	int old = p_dbf->scan_options;
+
+	p_dbf->scan_options = options;
+	return old;
+}
+/* }}} */
+
+/* dbf_ReadBlock() {{{
+ * Reads count records starting with record first (counted from 0) in one
+ * go. *records is set to the records, which either point into the memory
+ * buffer of the table or into buf, which must be large enough to hold
+ * count records. Short reads are continued until all records are read or
+ * the file ends. Returns the number of complete records or -1 on error.
+ */
+int dbf_ReadBlock(P_DBF *p_dbf, u_int32_t first, u_int32_t count, char *buf, const char **records)
+{
+	size_t reclen = p_dbf->header->record_length;
 	off_t offset;
+	ssize_t len, n;
 
-	if(p_dbf->cur_record >= p_dbf->header->records)
+	if(first >= p_dbf->header->records)
+		return 0;
+	if(count > p_dbf->header->records - first)
+		count = p_dbf->header->records - first;
+
+	offset = p_dbf->header->header_length + (off_t) first * reclen;
+	if(p_dbf->mem) {
+		if((size_t) offset >= p_dbf->mem_len)
+			return 0;
+		len = p_dbf->mem_len - offset;
+		if((size_t) len > count * reclen)
+			len = count * reclen;
+		*records = (const char *) p_dbf->mem + offset;
+		return len / reclen;
+	}
+
+	for(len = 0; (size_t) len < count * reclen; len += n) {
+		if((n = dbf_ReadAt(p_dbf, buf + len, count * reclen - len, offset + len)) == -1)
+			return -1;
+		if(n == 0)
+			break;
+	}
+	*records = buf;
+	return len / reclen;
+}
+/* }}} */
+
+/* dbf_IsDeleted() {{{
+ */
+int dbf_IsDeleted(P_DBF *p_dbf, const char *record) {
+	return record[0] == '*';
+}
+/* }}} */
+
+/* dbf_GetLiveBitmap() {{{
+ * Sets one bit per record which is not deleted. The records are read
+ * in large blocks and the deletion flags of eight records are packed
+ * into one byte at a time where the block starts on a whole byte.
+ */
+int dbf_GetLiveBitmap(P_DBF *p_dbf, unsigned char *bitmap) {
+	u_int32_t reclen = p_dbf->header->record_length;
+	u_int32_t blockrecs, recno, i, nrecs;
+	const char *records;
+	char *buf = NULL;
+	int n = 0, live = 0;
+
+	if(reclen == 0)
 		return -1;
 
-	offset = lseek(p_dbf->dbf_fh, p_dbf->header->header_length + p_dbf->cur_record * (p_dbf->header->record_length), SEEK_SET);
-//	fprintf(stdout, "Offset = %d, Record length = %d\n", offset, p_dbf->header->record_length);
-	if (read( p_dbf->dbf_fh, record, p_dbf->header->record_length) == -1 ) {
+	/* Keep blocks a multiple of 8 records so that they fill whole bytes */
+	blockrecs = (DBF_BLOCK_SIZE / reclen) & ~7;
+	if(blockrecs == 0)
+		blockrecs = 8;
+	if(NULL == p_dbf->mem && NULL == (buf = malloc(blockrecs * reclen)))
 		return -1;
+
+	nrecs = p_dbf->header->records;
+	memset(bitmap, 0, (nrecs + 7) / 8);
+
+	for(recno = 0; recno < nrecs; recno += n) {
+		if(0 >= (n = dbf_ReadBlock(p_dbf, recno, blockrecs, buf, &records)))
+			break;
+		for(i = 0; i < (u_int32_t) n && ((recno + i) & 7); i++) {
+			if(records[i * reclen] != '*') {
+				bitmap[(recno + i) / 8] |= 1 << ((recno + i) & 7);
+				live++;
+			}
+		}
+		for(; i + 8 <= (u_int32_t) n; i += 8) {
+			const char *r = records + i * reclen;
+			unsigned char bits;
+
+			bits  = (r[0] != '*');
+			bits |= (r[reclen] != '*') << 1;
+			bits |= (r[2 * reclen] != '*') << 2;
+			bits |= (r[3 * reclen] != '*') << 3;
+			bits |= (r[4 * reclen] != '*') << 4;
+			bits |= (r[5 * reclen] != '*') << 5;
+			bits |= (r[6 * reclen] != '*') << 6;
+			bits |= (r[7 * reclen] != '*') << 7;
+			bitmap[(recno + i) / 8] = bits;
+			live += dbf_popcount[bits];
+		}
+		for(; i < (u_int32_t) n; i++) {
+			if(records[i * reclen] != '*') {
+				bitmap[(recno + i) / 8] |= 1 << ((recno + i) & 7);
+				live++;
+			}
+		}
 	}
-	p_dbf->cur_record++;
+
+	if(buf)
+		free(buf);
+	if(n < 0)
+		return -1;
+
+	return live;
+}
+/* }}} */
+
+/* dbf_BitmapNext() {{{
+ * Returns the next record (counted from 0) at or after recno which is
+ * set in bitmap. Whole bytes of deleted records are skipped at once.
+ */
+int dbf_BitmapNext(const unsigned char *bitmap, int nrecords, int recno) {
+	int byte;
+
+	if(recno < 0)
+		recno = 0;
+	while(recno < nrecords) {
+		byte = bitmap[recno / 8] >> (recno & 7);
+		if(byte) {
+			while(!(byte & 1)) {
+				byte >>= 1;
+				recno++;
+			}
+			return recno < nrecords ? recno : -1;
+		}
+		recno = (recno | 7) + 1;
+	}
+
+	return -1;
+}
+/* }}} */
+
+/* dbf_ReadRecord() {{{
+ */
+int dbf_ReadRecord(P_DBF *p_dbf, char *record, int len) {
+	off_t offset;
+
+	do {
+		if(p_dbf->cur_record >= p_dbf->header->records)
+			return -1;
+
+		offset = p_dbf->header->header_length + (off_t) p_dbf->cur_record * p_dbf->header->record_length;
+//		fprintf(stdout, "Offset = %d, Record length = %d\n", offset, p_dbf->header->record_length);
+		if (dbf_ReadAt(p_dbf, record, p_dbf->header->record_length, offset) == -1 ) {
+			return -1;
+		}
+		p_dbf->cur_record++;
+	} while ((p_dbf->scan_options & DBF_SKIP_DELETED) && record[0] == '*');
 	return p_dbf->cur_record-1;
 }
 /* }}} */
 
+/* dbf_ReadRecordPtr() {{{
+ */
+const char *dbf_ReadRecordPtr(P_DBF *p_dbf) {
+	const char *record;
+	off_t offset;
+
+	if(NULL == p_dbf->mem)
+		return NULL;
+
+	do {
+		if(p_dbf->cur_record >= p_dbf->header->records)
+			return NULL;
+
+		offset = p_dbf->header->header_length + (off_t) p_dbf->cur_record * p_dbf->header->record_length;
+		if((size_t) offset + p_dbf->header->record_length > p_dbf->mem_len)
+			return NULL;
+
+		record = (const char *) p_dbf->mem + offset;
+		p_dbf->cur_record++;
+	} while ((p_dbf->scan_options & DBF_SKIP_DELETED) && record[0] == '*');
+
+	return record;
+}
+/* }}} */
+
 /* dbf_WriteRecord() {{{
  */
 int dbf_WriteRecord(P_DBF *p_dbf, char *record, int len) {
+	off_t offset;
 
 	if(len != p_dbf->header->record_length-1) {
 		fprintf(stderr, _("Length of record mismatches expected length (%d != %d)."), len, p_dbf->header->record_length);
 		fprintf(stderr, "\n");
 		return -1;
 	}
-	lseek(p_dbf->dbf_fh, 0, SEEK_END);
-	if (write( p_dbf->dbf_fh, " ", 1) == -1 ) {
+	if (p_dbf->mem_alloc) {
+		/* Records are appended to the buffer and the header is written
+		 * once when the table is closed by dbf_CloseMemory().
+		 */
+		offset = p_dbf->mem_len;
+		if (dbf_WriteAt(p_dbf, " ", 1, offset) == -1 ) {
+			return -1;
+		}
+		if (dbf_WriteAt(p_dbf, record, len, offset + 1) == -1 ) {
+			return -1;
+		}
+		p_dbf->header->records++;
+		return p_dbf->header->records;
+	}
+	if (p_dbf->open_flags & DBF_OPEN_SHARED) {
+		return dbf_AppendLocked(p_dbf, record, len);
+	}
+
+	/* The record goes behind the last one, over the end of file marker,
+	 * which is written again behind it. The file position is left alone
+	 * for the other threads reading with pread().
+	 */
+	offset = p_dbf->header->header_length + (off_t) p_dbf->header->records * p_dbf->header->record_length;
+	if (dbf_WriteAt(p_dbf, " ", 1, offset) == -1 ) {
+		return -1;
+	}
+	if (dbf_WriteAt(p_dbf, record, len, offset + 1) == -1 ) {
 		return -1;
 	}
-	if (write( p_dbf->dbf_fh, record, p_dbf->header->record_length-1) == -1 ) {
+	if (dbf_WriteAt(p_dbf, "\x1a", 1, offset + 1 + len) == -1 ) {
 		return -1;
 	}
 	p_dbf->header->records++;
@@ -580,6 +1206,107 @@ int dbf_WriteRecord(P_DBF *p_dbf, char *record, int len) {
 }
 /* }}} */
 
+/* static dbf_UpdateAt() {{{
+ * Modifies len bytes of existing records starting at offset
+ */
+static int dbf_UpdateAt(P_DBF *p_dbf, const char *data, int len, off_t offset) {
+	if (p_dbf->mem_alloc) {
+		return dbf_WriteAt(p_dbf, data, len, offset) == -1 ? -1 : 0;
+	}
+	if (p_dbf->mem || !(p_dbf->open_flags & DBF_OPEN_RDWR)) {
+		return -1;
+	}
+	return dbf_CacheWrite(p_dbf, data, len, offset) == -1 ? -1 : 0;
+}
+/* }}} */
+
+/* dbf_UpdateRecord() {{{
+ */
+int dbf_UpdateRecord(P_DBF *p_dbf, int recno, int column, const char *value) {
+	char data[256], flags;
+	off_t record, flagpos = -1;
+	int len, size, bit;
+
+	if(recno < 0 || recno >= (int) p_dbf->header->records)
+		return -1;
+	if(column < 0 || column >= p_dbf->columns)
+		return -1;
+
+	size = p_dbf->fields[column].field_length;
+	/* Binary fields of Visual FoxPro cannot hold text, they are set by
+	 * the typed setters like dbf_PutInt64() with dbf_UpdateRecordData()
+	 */
+	switch(p_dbf->fields[column].field_type) {
+		case 'I':
+		case 'Y':
+		case 'T':
+		case '0':
+			return -1;
+		case 'B':
+			if(size == 8)
+				return -1;
+			break;
+		case 'M':
+		case 'G':
+		case 'P':
+			if(size == 4)
+				return -1;
+			break;
+	}
+
+	record = p_dbf->header->header_length + (off_t) recno * p_dbf->header->record_length;
+	/* A value written is no longer null */
+	if(p_dbf->null_bits && (bit = p_dbf->null_bits[column]) >= 0) {
+		flagpos = record + p_dbf->nullflags + bit / 8;
+		if(dbf_ReadAt(p_dbf, &flags, 1, flagpos) != 1)
+			return -1;
+		flags &= ~(1 << (bit & 7));
+	}
+
+	len = strlen(value);
+	/* Numbers are aligned right, everything else left. Cutting a number
+	 * would keep its leading digits and store a different value.
+	 */
+	memset(data, ' ', size);
+	switch(p_dbf->fields[column].field_type) {
+		case 'N':
+		case 'F':
+			if(len > size)
+				return -1;
+			memcpy(data + size - len, value, len);
+			break;
+		default:
+			if(len > size)
+				len = size;
+			memcpy(data, value, len);
+			break;
+	}
+
+	if(0 > dbf_UpdateAt(p_dbf, data, size, record + p_dbf->fields[column].field_offset))
+		return -1;
+	if(flagpos >= 0)
+		return dbf_UpdateAt(p_dbf, &flags, 1, flagpos);
+	return 0;
+}
+/* }}} */
+
+/* dbf_UpdateRecordData() {{{
+ */
+int dbf_UpdateRecordData(P_DBF *p_dbf, int recno, const char *record, int len) {
+	if(recno < 0 || recno >= (int) p_dbf->header->records)
+		return -1;
+	if(len != p_dbf->header->record_length-1) {
+		fprintf(stderr, _("Length of record mismatches expected length (%d != %d)."), len, p_dbf->header->record_length);
+		fprintf(stderr, "\n");
+		return -1;
+	}
+
+	/* The deletion flag is kept as it is */
+	return dbf_UpdateAt(p_dbf, record, len,
+		p_dbf->header->header_length + (off_t) recno * p_dbf->header->record_length + 1);
+}
+/* }}} */
+
 /* dbf_GetRecordData() {{{
  */
 char *dbf_GetRecordData(P_DBF *p_dbf, char *record, int column) {
@@ -67,6 +67,7 @@
 #include <string.h>
 #include <limits.h>
 #include <assert.h>
+#include <errno.h>
 
 /*
  * special anubisnet and dbf includes
@@ -79,6 +80,23 @@
 #define IS_NUMERIC 2
 //@}
 
+/*! Size of the blocks read at once when scanning whole tables */
+#define DBF_BLOCK_SIZE (1024 * 1024)
+
+/*! Maximum number of threads used for parallel tasks */
+#define DBF_MAX_THREADS 64
+
+/*! Size of the pages in which updated records are cached */
+#define DBF_PAGE_SIZE (64 * 1024)
+/*! Number of pages cached at most */
+#define DBF_CACHE_PAGES 256
+
+/*! Julian day number of 1970-01-01, the base of Visual FoxPro datetimes */
+#define DBF_JULIAN_EPOCH 2440588
+
+/*! Largest 64 bit integer */
+#define DBF_INT64_MAX 9223372036854775807LL
+
 /*
  *	STRUCTS
  */
@@ -125,7 +143,8 @@ typedef struct {
 struct _DB_FIELD {
 	/*! Byte: 0-10; fieldname in ASCII */
 	unsigned char field_name[11];
-	/*! Byte: 11; field type in ASCII (C, D, L, M or N) */
+	/*! Byte: 11; field type in ASCII (C, D, L, M or N, in Visual FoxPro
+		also I, B, Y, T and 0 for the _NullFlags column) */
 	unsigned char field_type;
 	/*! Byte: 12-15; field data adress */
 	u_int32_t field_address;
@@ -133,14 +152,59 @@ struct _DB_FIELD {
 	unsigned char field_length;
 	/*! Byte: 17; field decimal count in binary */
 	unsigned char field_decimals;
-	/*! Byte: 18-30; reserved */
-	unsigned char reserved1[2];
+	/*! Byte: 18; field flags of Visual FoxPro */
+	unsigned char field_flags;
+	/*! Byte: 19-30; reserved */
+	unsigned char reserved1;
 	u_int32_t field_offset;
 	unsigned char reserved2[7];
 	/*! Byte: 31; Production MDX field flag */
 	unsigned char mdx;
 };
 
+/*! \struct DBF_PAGE
+	\brief page of the file holding updated records
+ */
+typedef struct {
+	/*! number of the page within the file, -1 if unused */
+	off_t page;
+	/*! modified bytes of the page, the others are undefined */
+	unsigned char *data;
+	/*! one bit per byte of data which has been modified */
+	unsigned char *dirty;
+	/*! first modified byte within the page */
+	u_int32_t dirty_start;
+	/*! end of the modified bytes, equals dirty_start if page is clean */
+	u_int32_t dirty_end;
+} DBF_PAGE;
+
+/*! \typedef DBF_FLAG
+	\brief flag set and read by the workers of dbf_RunTasks(), like a
+	request to stop. Tasks run in one thread without atomics.
+ */
+#ifdef HAVE_STDATOMIC_H
+#include <stdatomic.h>
+typedef atomic_int DBF_FLAG;
+#else
+typedef int DBF_FLAG;
+#endif
+
+typedef void (*DBF_DECODER)(const char *data, int len, DBF_VALUE *value);
+
+/*! \struct DBF_PLAN
+	\brief how to decode the fields of a record, one array per property
+ */
+typedef struct {
+	/*! decoder per column */
+	DBF_DECODER *decode;
+	/*! position of the field within the record per column */
+	u_int32_t *offset;
+	/*! length of the field per column */
+	int *length;
+	/*! DBF_VALUE_* type of the decoded values per column */
+	unsigned char *type;
+} DBF_PLAN;
+
 /*! \struct P_DBF
 	\brief P_DBF is a global file handler
 
@@ -152,25 +216,99 @@ struct _P_DBF {
 	int dbf_fh;
 	/*! filehandler of memo */
 	int dbt_fh;
+	/*! name of the file, NULL for stdin and memory buffers */
+	char *filename;
+	/*! flags passed to dbf_OpenEx() */
+	int open_flags;
+	/*! buffer of a table opened with dbf_OpenMemory(), NULL for files */
+	const unsigned char *mem;
+	/*! size of the memory buffer in bytes */
+	size_t mem_len;
+	/*! growable buffer of a table created with dbf_CreateMemory() */
+	unsigned char *mem_alloc;
+	/*! allocated size of mem_alloc in bytes */
+	size_t mem_size;
+	/*! position in a pipe like stdin, which is read in order, -1 for files */
+	off_t stream_pos;
 	/*! the pysical size of the file, as stated from filesystem */
-	u_int32_t real_filesize;
+	off_t real_filesize;
 	/*! the calculated filesize */
-	u_int32_t calc_filesize;
+	off_t calc_filesize;
 	/*! header of .dbf file */
 	DB_HEADER *header;
 	/*! array of field specification */
 	DB_FIELD *fields;
 	/*! number of fields */
 	u_int32_t columns;
-	/*! integrity could be: valid, invalid */
+	/*! offset of the _NullFlags field in the record, 0 if there is none */
+	u_int32_t nullflags;
+	/*! bit within _NullFlags per field, -1 if the field cannot be null */
+	int *null_bits;
+	/*! decode plan built from the fields when the table is opened */
+	DBF_PLAN *plan;
+	/*! integrity could be: valid, invalid, set by dbf_CheckSize() */
 	unsigned char integrity[7];
 	/*! record counter */
 	int cur_record;
+	/*! options set by dbf_SetScanOptions() */
+	int scan_options;
+	/*! cached pages of updated records, NULL until the first update */
+	DBF_PAGE *pages;
+	/*! codepage set by dbf_SetCodepage(), 0 to use the language driver */
+	int codepage;
+	/*! UTF-8 sequences of the characters 0x80 - 0xFF, 4 bytes each */
+	unsigned char *utf8;
 	/*! errorhandler, maximum of 254 characters */
 	char errmsg[254];
 };
 
+/*! \struct DBF_SET
+	\brief DBF_SET is a set of files with the same fields
+*/
+struct _DBF_SET {
+	/*! number of files */
+	int nfiles;
+	/*! names of the files */
+	char **files;
+	/*! number of records of each file when the set was opened */
+	u_int32_t *records;
+	/*! maximum number of files read at the same time besides schema, 0 for one per thread */
+	int maxopen;
+	/*! the first file, which stays open to describe the fields */
+	P_DBF *schema;
+};
+
+
+/*
+ *	INTERNAL FUNCTIONS
+ */
+ssize_t dbf_ReadAt(P_DBF *p_dbf, void *buf, size_t len, off_t offset);
+ssize_t dbf_WriteAt(P_DBF *p_dbf, const void *buf, size_t len, off_t offset);
+int dbf_WriteHeaderInfo(P_DBF *p_dbf, DB_HEADER *header);
+int dbf_ReadBlock(P_DBF *p_dbf, u_int32_t first, u_int32_t count, char *buf, const char **records);
+ssize_t dbf_CacheWrite(P_DBF *p_dbf, const void *buf, size_t len, off_t offset);
+void dbf_CacheOverlay(P_DBF *p_dbf, void *buf, size_t len, off_t offset);
+void dbf_CacheFree(P_DBF *p_dbf);
+
+typedef void (*DBF_TASK)(void *ctx, int task, int worker);
+int dbf_NumThreads(int threads);
+int dbf_TableThreads(P_DBF *p_dbf, int threads);
+int dbf_RunTasks(int threads, int ntasks, DBF_TASK task, void *ctx);
+
+int dbf_WriteAll(int fd, const char *buf, size_t len);
 
+int dbf_ParseNumber(const char *data, int len, int64_t *mantissa, int *scale);
+int dbf_ParseInt64(const char *data, int len, int64_t *value);
+int dbf_ParseDouble(const char *data, int len, double *value);
+int32_t dbf_DaysFromCivil(int year, int month, int day);
+void dbf_CivilFromDays(int32_t days, int *year, int *month, int *day);
+int dbf_ParseDate(const char *data, int len, int32_t *days);
+int dbf_ParseLogical(const char *data, int len, int *value);
+int dbf_BuildPlan(P_DBF *p_dbf);
+int dbf_CheckSize(P_DBF *p_dbf);
+int dbf_Lock(P_DBF *p_dbf, off_t offset, int type);
+int dbf_AppendLocked(P_DBF *p_dbf, const char *record, int len);
+int dbf_WriteHeaderShared(P_DBF *p_dbf);
 
 /* Memo File Structure (.FPT)
  * Memo files contain one header record and any number of block structures.
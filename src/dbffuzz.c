@@ -0,0 +1,248 @@
+/*****************************************************************************
+ * dbffuzz.c
+ *****************************************************************************
+ * Fuzz and stress driver for opening and decoding dBASE files
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "../include/libdbf/libdbf.h"
+
+/*
+ * Every input is opened from memory by dbf_OpenMemory() and from a file
+ * by dbf_Open(), and the first records are decoded by dbf_DecodeRecord()
+ * and the typed getters. Malformed headers must be rejected when the
+ * table is opened, so the decoding never reads outside of the records.
+ *
+ * Built as it is, the driver is a stress test: it reads the files given
+ * on the command line and opens randomly damaged copies of them, e.g.
+ *
+ *	./dbffuzz -n 100000 table1.dbf table2.dbf
+ *
+ * Built with -DDBF_LIBFUZZER and -fsanitize=fuzzer,address, libFuzzer
+ * provides main() and calls LLVMFuzzerTestOneInput() itself:
+ *
+ *	make dbffuzz CFLAGS="-g -O1 -fsanitize=fuzzer,address -DDBF_LIBFUZZER"
+ */
+
+/* records decoded per input */
+#define DBF_FUZZ_RECORDS 64
+
+/* largest input in bytes */
+#define DBF_FUZZ_MAXLEN (1024 * 1024)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static char *fuzz_file = NULL;
+
+/* static dbffuzz_Decode() {{{
+ * Decodes the first records of an opened table
+ */
+static void dbffuzz_Decode(P_DBF *p_dbf)
+{
+	DBF_VALUE *values;
+	char *record;
+	int i, n, cols, len;
+	int64_t iv;
+	double dv;
+
+	cols = dbf_NumCols(p_dbf);
+	len = dbf_RecordLength(p_dbf);
+	if (cols <= 0 || len <= 0)
+		return;
+	values = malloc(cols * sizeof(DBF_VALUE));
+	record = malloc(len);
+	if (NULL == values || NULL == record) {
+		free(values);
+		free(record);
+		return;
+	}
+
+	for (n = 0; n < DBF_FUZZ_RECORDS && dbf_ReadRecord(p_dbf, record, len) >= 0; n++) {
+		if (0 > dbf_DecodeRecord(p_dbf, record, values))
+			break;
+		for (i = 0; i < cols; i++) {
+			dbf_IsNull(p_dbf, record, i);
+			dbf_GetInt64(p_dbf, record, i, &iv);
+			dbf_GetDouble(p_dbf, record, i, &dv);
+			dbf_GetCurrency(p_dbf, record, i, &iv);
+			dbf_GetDateTime(p_dbf, record, i, &iv);
+		}
+	}
+
+	free(values);
+	free(record);
+}
+/* }}} */
+
+/* LLVMFuzzerTestOneInput() {{{
+ * Opens one input from memory and from a file
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	P_DBF *p_dbf;
+	int fh;
+
+	if (size > DBF_FUZZ_MAXLEN)
+		return 0;
+
+	if (NULL != (p_dbf = dbf_OpenMemory(data, size))) {
+		dbffuzz_Decode(p_dbf);
+		dbf_Close(p_dbf);
+	}
+
+	if (NULL == fuzz_file) {
+		char name[] = "/tmp/dbffuzzXXXXXX";
+
+		if ((fh = mkstemp(name)) == -1)
+			return 0;
+		close(fh);
+		if (NULL == (fuzz_file = strdup(name)))
+			return 0;
+	}
+	if ((fh = open(fuzz_file, O_WRONLY|O_TRUNC|O_BINARY)) == -1)
+		return 0;
+	if (write(fh, data, size) != (ssize_t) size) {
+		close(fh);
+		return 0;
+	}
+	close(fh);
+	if (NULL != (p_dbf = dbf_Open(fuzz_file))) {
+		dbffuzz_Decode(p_dbf);
+		dbf_Close(p_dbf);
+	}
+
+	return 0;
+}
+/* }}} */
+
+#ifndef DBF_LIBFUZZER
+
+/* static dbffuzz_Mutate() {{{
+ * Damages a copy of the input: overwrites bytes, mostly in the header,
+ * and sometimes cuts the copy short
+ */
+static size_t dbffuzz_Mutate(unsigned char *buf, size_t len)
+{
+	size_t pos, head = len < 512 ? len : 512;
+	int i, k = rand() % 8 + 1;
+
+	for (i = 0; i < k; i++) {
+		pos = (rand() % 4) ? rand() % head : rand() % len;
+		switch (rand() % 3) {
+			case 0:
+				buf[pos] = rand();
+				break;
+			case 1:
+				buf[pos] ^= 1 << (rand() % 8);
+				break;
+			default:
+				buf[pos] = (rand() % 2) ? 0x00 : 0xFF;
+				break;
+		}
+	}
+	if (rand() % 4 == 0)
+		len = rand() % len + 1;
+
+	return len;
+}
+/* }}} */
+
+/* main() {{{
+ */
+int main(int argc, char **argv)
+{
+	unsigned char *seed, *buf;
+	long iterations = 10000, n;
+	size_t len, cut;
+	int i, c, fh;
+	ssize_t r;
+
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+			case 'n':
+				iterations = atol(optarg);
+				break;
+			case 's':
+				srand(atoi(optarg));
+				break;
+			default:
+				fprintf(stderr, "Usage: dbffuzz [-n iterations] [-s seed] file...\n");
+				return 2;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "Usage: dbffuzz [-n iterations] [-s seed] file...\n");
+		return 2;
+	}
+
+	seed = malloc(DBF_FUZZ_MAXLEN);
+	buf = malloc(DBF_FUZZ_MAXLEN);
+	if (NULL == seed || NULL == buf)
+		return 1;
+
+	for (i = optind; i < argc; i++) {
+		if ((fh = open(argv[i], O_RDONLY|O_BINARY)) == -1) {
+			perror(argv[i]);
+			return 1;
+		}
+		for (len = 0; len < DBF_FUZZ_MAXLEN; len += r) {
+			if ((r = read(fh, seed + len, DBF_FUZZ_MAXLEN - len)) <= 0)
+				break;
+		}
+		close(fh);
+		if (len == 0)
+			continue;
+
+		/* The intact file first */
+		LLVMFuzzerTestOneInput(seed, len);
+		for (n = 0; n < iterations; n++) {
+			memcpy(buf, seed, len);
+			cut = dbffuzz_Mutate(buf, len);
+			LLVMFuzzerTestOneInput(buf, cut);
+		}
+		printf("%s: %ld inputs\n", argv[i], iterations + 1);
+	}
+
+	if (fuzz_file) {
+		unlink(fuzz_file);
+		free(fuzz_file);
+	}
+	free(seed);
+	free(buf);
+
+	return 0;
+}
+/* }}} */
+
+#endif
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
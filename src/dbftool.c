@@ -0,0 +1,584 @@
+/*****************************************************************************
+ * dbftool.c
+ *****************************************************************************
+ * Command line tool to inspect, export and maintain dBASE files
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <stdint.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifdef ENABLE_NLS
+#include <libintl.h>
+#define _(a) dgettext(GETTEXT_PACKAGE, a)
+#else
+#define _(a) a
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "../include/libdbf/libdbf.h"
+
+/*
+ * The tool only uses the public interface of the library, so it also
+ * serves as a check of the whole library. Files which are only read are
+ * mapped into memory and opened by dbf_OpenMemory(), which lets the
+ * scans work on the mapping without copying the records. Every command
+ * prints the time it took and the throughput to stderr unless -q is
+ * given, so the output itself can be piped into other programs.
+ */
+
+struct dbftool_Table {
+	P_DBF *dbf;
+	void *map;
+	size_t len;
+};
+
+static int threads = 0;
+static int quiet = 0;
+static int skip_deleted = 0;
+
+/* static dbftool_Usage() {{{
+ */
+static void dbftool_Usage(void)
+{
+	fprintf(stderr, _("Usage: dbftool [-t threads] [-d] [-q] command file [arguments]\n"
+		"\n"
+		"Commands:\n"
+		"  info FILE                    show the header and the fields\n"
+		"  head FILE [N]                print the first N records, 10 by default\n"
+		"  count FILE                   count all and deleted records\n"
+		"  stats FILE [COLUMN...]       count, sum, minimum and maximum of columns\n"
+		"  export csv|arrow FILE [OUT]  write all records to OUT or stdout\n"
+		"  pack FILE                    remove deleted records\n"
+		"  verify FILE                  check the file and print its checksum\n"
+		"\n"
+		"Options:\n"
+		"  -t threads  number of threads, one per processor by default\n"
+		"  -d          skip deleted records\n"
+		"  -q          do not print timing and throughput\n"));
+}
+/* }}} */
+
+/* static dbftool_Now() {{{
+ * Returns the time in seconds
+ */
+static double dbftool_Now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+/* }}} */
+
+/* static dbftool_Report() {{{
+ * Prints the time since start and the throughput for the given number of
+ * records and bytes
+ */
+static void dbftool_Report(const char *command, double start, long records, double bytes)
+{
+	double secs = dbftool_Now() - start;
+
+	/* The report follows the output of the command */
+	fflush(stdout);
+	if (quiet)
+		return;
+	if (secs <= 0)
+		secs = 1e-6;
+	fprintf(stderr, _("%s: %ld records, %.1f MB in %.3f s, %.0f records/s, %.1f MB/s\n"),
+		command, records, bytes / 1e6, secs, records / secs, bytes / 1e6 / secs);
+}
+/* }}} */
+
+/* static dbftool_Open() {{{
+ * Opens the table, read-only tables are mapped into memory if possible
+ */
+static int dbftool_Open(struct dbftool_Table *t, const char *file, int flags)
+{
+#ifdef HAVE_SYS_MMAN_H
+	struct stat st;
+	int fh;
+#endif
+
+	memset(t, 0, sizeof(*t));
+#ifdef HAVE_SYS_MMAN_H
+	if (flags == 0 && strcmp(file, "-") != 0 &&
+		(fh = open(file, O_RDONLY|O_BINARY)) != -1) {
+		if (fstat(fh, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+			t->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fh, 0);
+			if (t->map == MAP_FAILED)
+				t->map = NULL;
+			else
+				t->len = st.st_size;
+		}
+		close(fh);
+		if (t->map && NULL == (t->dbf = dbf_OpenMemory(t->map, t->len))) {
+			munmap(t->map, t->len);
+			t->map = NULL;
+		}
+	}
+#endif
+	if (NULL == t->dbf && NULL == (t->dbf = dbf_OpenEx(file, flags))) {
+		fprintf(stderr, _("dbftool: cannot open %s\n"), file);
+		return -1;
+	}
+	if (skip_deleted)
+		dbf_SetScanOptions(t->dbf, DBF_SKIP_DELETED);
+
+	return 0;
+}
+/* }}} */
+
+/* static dbftool_Close() {{{
+ */
+static void dbftool_Close(struct dbftool_Table *t)
+{
+	dbf_Close(t->dbf);
+#ifdef HAVE_SYS_MMAN_H
+	if (t->map)
+		munmap(t->map, t->len);
+#endif
+}
+/* }}} */
+
+/* static dbftool_TableBytes() {{{
+ * Returns the size of the header and all records
+ */
+static double dbftool_TableBytes(P_DBF *p_dbf)
+{
+	return dbf_HeaderSize(p_dbf) + (double) dbf_NumRows(p_dbf) * dbf_RecordLength(p_dbf);
+}
+/* }}} */
+
+/* static dbftool_Column() {{{
+ * Returns the number of the column with the given name or -1
+ */
+static int dbftool_Column(P_DBF *p_dbf, const char *name)
+{
+	int i;
+
+	for (i = 0; i < dbf_NumCols(p_dbf); i++) {
+		if (strcasecmp(dbf_ColumnName(p_dbf, i), name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+/* }}} */
+
+/* static dbftool_Civil() {{{
+ * Converts days since 1970-01-01 into year, month and day
+ */
+static void dbftool_Civil(long days, int *year, int *month, int *day)
+{
+	long era, doe, yoe, doy, mp;
+
+	days += 719468;
+	era = (days >= 0 ? days : days - 146096) / 146097;
+	doe = days - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	*day = doy - (153 * mp + 2) / 5 + 1;
+	*month = mp < 10 ? mp + 3 : mp - 9;
+	*year = yoe + era * 400 + (*month <= 2);
+}
+/* }}} */
+
+/* static dbftool_PrintValue() {{{
+ */
+static void dbftool_PrintValue(P_DBF *p_dbf, int column, DBF_VALUE *v)
+{
+	int year, month, day;
+	int64_t ms, c;
+
+	switch (v->type) {
+		case DBF_VALUE_NULL:
+			break;
+		case DBF_VALUE_STRING:
+			fwrite(v->v.str.data, 1, v->v.str.len, stdout);
+			break;
+		case DBF_VALUE_INT:
+			printf("%lld", (long long) v->v.i);
+			break;
+		case DBF_VALUE_DOUBLE:
+			if (dbf_ColumnDecimals(p_dbf, column) > 0)
+				printf("%.*f", dbf_ColumnDecimals(p_dbf, column), v->v.d);
+			else
+				printf("%.15g", v->v.d);
+			break;
+		case DBF_VALUE_DATE:
+			dbftool_Civil(v->v.days, &year, &month, &day);
+			printf("%04d-%02d-%02d", year, month, day);
+			break;
+		case DBF_VALUE_BOOL:
+			putchar(v->v.b ? 'T' : 'F');
+			break;
+		case DBF_VALUE_DATETIME:
+			ms = v->v.i;
+			dbftool_Civil((long) ((ms >= 0 ? ms : ms - 86399999) / 86400000), &year, &month, &day);
+			ms -= (ms >= 0 ? ms : ms - 86399999) / 86400000 * 86400000;
+			printf("%04d-%02d-%02d %02d:%02d:%02d", year, month, day,
+				(int) (ms / 3600000), (int) (ms / 60000 % 60), (int) (ms / 1000 % 60));
+			break;
+		case DBF_VALUE_CURRENCY:
+			c = v->v.i;
+			printf("%s%lld.%04lld", c < 0 ? "-" : "",
+				(long long) ((c < 0 ? -c : c) / 10000), (long long) ((c < 0 ? -c : c) % 10000));
+			break;
+	}
+}
+/* }}} */
+
+/* static dbftool_Info() {{{
+ */
+static int dbftool_Info(const char *file)
+{
+	struct dbftool_Table t;
+	int i;
+
+	if (0 > dbftool_Open(&t, file, 0))
+		return 1;
+
+	printf(_("Version:       %s\n"), dbf_GetStringVersion(t.dbf));
+	printf(_("Last update:   %s\n"), dbf_GetDate(t.dbf));
+	printf(_("Records:       %d\n"), dbf_NumRows(t.dbf));
+	printf(_("Header size:   %d\n"), dbf_HeaderSize(t.dbf));
+	printf(_("Record length: %d\n"), dbf_RecordLength(t.dbf));
+	printf(_("Codepage:      %d\n"), dbf_GetCodepage(t.dbf));
+	printf(_("Memo file:     %s\n"), dbf_IsMemo(t.dbf) == 1 ? _("yes") : _("no"));
+	printf(_("Columns:       %d\n\n"), dbf_NumCols(t.dbf));
+	printf(_("  # Name        Type Length Decimals\n"));
+	for (i = 0; i < dbf_NumCols(t.dbf); i++) {
+		printf("%3d %-11s %c    %6d %8d\n", i, dbf_ColumnName(t.dbf, i),
+			dbf_ColumnType(t.dbf, i), dbf_ColumnSize(t.dbf, i), dbf_ColumnDecimals(t.dbf, i));
+	}
+
+	dbftool_Close(&t);
+	return 0;
+}
+/* }}} */
+
+/* static dbftool_Head() {{{
+ * Prints the records tab separated, one per line
+ */
+static int dbftool_Head(const char *file, long n)
+{
+	struct dbftool_Table t;
+	DBF_VALUE *values;
+	char *record;
+	int i, cols, first;
+	long count = 0;
+	double start;
+
+	if (0 > dbftool_Open(&t, file, 0))
+		return 1;
+	cols = dbf_NumCols(t.dbf);
+	values = malloc(cols * sizeof(DBF_VALUE));
+	record = malloc(dbf_RecordLength(t.dbf));
+	if (NULL == values || NULL == record) {
+		free(values);
+		free(record);
+		dbftool_Close(&t);
+		return 1;
+	}
+
+	start = dbftool_Now();
+	/* _NullFlags is left out, null fields are printed empty */
+	for (i = 0, first = 1; i < cols; i++) {
+		if (dbf_ColumnType(t.dbf, i) == '0')
+			continue;
+		printf("%s%s", first ? "" : "\t", dbf_ColumnName(t.dbf, i));
+		first = 0;
+	}
+	putchar('\n');
+	while (count < n && dbf_ReadRecord(t.dbf, record, dbf_RecordLength(t.dbf)) >= 0) {
+		if (0 > dbf_DecodeRecord(t.dbf, record, values))
+			break;
+		for (i = 0, first = 1; i < cols; i++) {
+			if (dbf_ColumnType(t.dbf, i) == '0')
+				continue;
+			if (!first)
+				putchar('\t');
+			dbftool_PrintValue(t.dbf, i, &values[i]);
+			first = 0;
+		}
+		putchar('\n');
+		count++;
+	}
+	dbftool_Report("head", start, count, (double) count * dbf_RecordLength(t.dbf));
+
+	free(values);
+	free(record);
+	dbftool_Close(&t);
+	return 0;
+}
+/* }}} */
+
+/* static dbftool_Count() {{{
+ */
+static int dbftool_Count(const char *file)
+{
+	struct dbftool_Table t;
+	unsigned char *bitmap;
+	int rows, live;
+	double start;
+
+	if (0 > dbftool_Open(&t, file, 0))
+		return 1;
+	rows = dbf_NumRows(t.dbf);
+	if (NULL == (bitmap = malloc(rows / 8 + 1))) {
+		dbftool_Close(&t);
+		return 1;
+	}
+
+	start = dbftool_Now();
+	if (0 > (live = dbf_GetLiveBitmap(t.dbf, bitmap))) {
+		fprintf(stderr, _("dbftool: cannot read %s\n"), file);
+		free(bitmap);
+		dbftool_Close(&t);
+		return 1;
+	}
+	printf(_("%d records, %d live, %d deleted\n"), rows, live, rows - live);
+	dbftool_Report("count", start, rows, dbftool_TableBytes(t.dbf));
+
+	free(bitmap);
+	dbftool_Close(&t);
+	return 0;
+}
+/* }}} */
+
+/* static dbftool_Stats() {{{
+ * Aggregates the given columns or all columns which are not text
+ */
+static int dbftool_Stats(const char *file, char **names, int nnames)
+{
+	struct dbftool_Table t;
+	DBF_AGGREGATE *a;
+	int i, n, column, ngroups, scans = 0, ret = 0;
+	double start;
+
+	if (0 > dbftool_Open(&t, file, 0))
+		return 1;
+	n = nnames > 0 ? nnames : dbf_NumCols(t.dbf);
+
+	printf(_("%-11s %10s %20s %20s %20s %20s\n"), _("Column"), _("Count"), _("Sum"), _("Min"), _("Max"), _("Mean"));
+	start = dbftool_Now();
+	for (i = 0; i < n; i++) {
+		if (nnames > 0) {
+			if (0 > (column = dbftool_Column(t.dbf, names[i]))) {
+				fprintf(stderr, _("dbftool: no column %s\n"), names[i]);
+				ret = 1;
+				continue;
+			}
+		} else {
+			column = i;
+			if (dbf_ColumnType(t.dbf, column) == 'C' || dbf_ColumnType(t.dbf, column) == '0')
+				continue;
+		}
+		if (NULL == (a = dbf_Aggregate(t.dbf, column, -1, &ngroups, threads))) {
+			/* Memo and other text columns cannot be aggregated,
+			 * and stdin cannot be read a second time
+			 */
+			if (nnames > 0 || (scans > 0 && strcmp(file, "-") == 0)) {
+				fprintf(stderr, _("dbftool: cannot aggregate column %s\n"), dbf_ColumnName(t.dbf, column));
+				ret = 1;
+			}
+			continue;
+		}
+		printf("%-11s %10ld %20.6g %20.6g %20.6g %20.6g\n", dbf_ColumnName(t.dbf, column),
+			a->count, a->sum, a->min, a->max, a->count ? a->sum / a->count : 0.0);
+		free(a);
+		scans++;
+	}
+	dbftool_Report("stats", start, (long) scans * dbf_NumRows(t.dbf), scans * dbftool_TableBytes(t.dbf));
+
+	dbftool_Close(&t);
+	return ret;
+}
+/* }}} */
+
+/* static dbftool_Export() {{{
+ */
+static int dbftool_Export(const char *format, const char *file, const char *out)
+{
+	struct dbftool_Table t;
+	int fd = fileno(stdout), flags = DBF_CSV_HEADER;
+	long records;
+	double start;
+
+	if (strcmp(format, "csv") != 0 && strcmp(format, "arrow") != 0) {
+		dbftool_Usage();
+		return 2;
+	}
+	if (0 > dbftool_Open(&t, file, 0))
+		return 1;
+	if (out && (fd = open(out, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY, 0644)) == -1) {
+		fprintf(stderr, _("dbftool: cannot create %s\n"), out);
+		dbftool_Close(&t);
+		return 1;
+	}
+	/* Text of unknown codepages is written as it is */
+	if (dbf_GetCodepage(t.dbf) > 0)
+		flags |= DBF_CSV_UTF8;
+
+	start = dbftool_Now();
+	if (format[0] == 'c')
+		records = dbf_ExportCSV(t.dbf, fd, ',', flags, threads);
+	else
+		records = dbf_ExportArrow(t.dbf, fd, 0);
+	if (out && close(fd) == -1)
+		records = -1;
+	if (records < 0) {
+		fprintf(stderr, _("dbftool: cannot export %s\n"), file);
+		dbftool_Close(&t);
+		return 1;
+	}
+	dbftool_Report("export", start, records, dbftool_TableBytes(t.dbf));
+
+	dbftool_Close(&t);
+	return 0;
+}
+/* }}} */
+
+/* static dbftool_Pack() {{{
+ */
+static int dbftool_Pack(const char *file)
+{
+	struct dbftool_Table t;
+	int64_t reclaimed = 0;
+	double start, bytes;
+	long records;
+
+	if (0 > dbftool_Open(&t, file, DBF_OPEN_RDWR))
+		return 1;
+	records = dbf_NumRows(t.dbf);
+	bytes = dbftool_TableBytes(t.dbf);
+
+	start = dbftool_Now();
+	if (0 > dbf_Pack(t.dbf, DBF_PACK_INPLACE, &reclaimed)) {
+		fprintf(stderr, _("dbftool: cannot pack %s\n"), file);
+		dbftool_Close(&t);
+		return 1;
+	}
+	printf(_("%ld records removed, %lld bytes reclaimed\n"),
+		records - dbf_NumRows(t.dbf), (long long) reclaimed);
+	dbftool_Report("pack", start, records, bytes);
+
+	dbftool_Close(&t);
+	return 0;
+}
+/* }}} */
+
+/* static dbftool_Verify() {{{
+ */
+static int dbftool_Verify(const char *file)
+{
+	struct dbftool_Table t;
+	u_int32_t checksum = 0;
+	double start;
+	int ret;
+
+	if (0 > dbftool_Open(&t, file, 0))
+		return 1;
+
+	start = dbftool_Now();
+	ret = dbf_Verify(t.dbf, &checksum, threads);
+	if (ret < 0) {
+		fprintf(stderr, _("dbftool: cannot verify %s\n"), file);
+		dbftool_Close(&t);
+		return 1;
+	}
+	printf(_("%s: %s, checksum %08x\n"), file, ret == 0 ? _("intact") : _("damaged"), checksum);
+	dbftool_Report("verify", start, dbf_NumRows(t.dbf), dbftool_TableBytes(t.dbf));
+
+	dbftool_Close(&t);
+	return ret;
+}
+/* }}} */
+
+/* main() {{{
+ * Returns 0 on success, 1 on errors or damaged files and 2 on wrong usage
+ */
+int main(int argc, char **argv)
+{
+	const char *command;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:dqh")) != -1) {
+		switch (c) {
+			case 't':
+				threads = atoi(optarg);
+				break;
+			case 'd':
+				skip_deleted = 1;
+				break;
+			case 'q':
+				quiet = 1;
+				break;
+			default:
+				dbftool_Usage();
+				return c == 'h' ? 0 : 2;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc < 2) {
+		dbftool_Usage();
+		return 2;
+	}
+	command = argv[0];
+
+	if (strcmp(command, "info") == 0 && argc == 2)
+		return dbftool_Info(argv[1]);
+	if (strcmp(command, "head") == 0 && argc <= 3)
+		return dbftool_Head(argv[1], argc == 3 ? atol(argv[2]) : 10);
+	if (strcmp(command, "count") == 0 && argc == 2)
+		return dbftool_Count(argv[1]);
+	if (strcmp(command, "stats") == 0)
+		return dbftool_Stats(argv[1], argv + 2, argc - 2);
+	if (strcmp(command, "export") == 0 && (argc == 3 || argc == 4))
+		return dbftool_Export(argv[1], argv[2], argc == 4 ? argv[3] : NULL);
+	if (strcmp(command, "pack") == 0 && argc == 2)
+		return dbftool_Pack(argv[1]);
+	if (strcmp(command, "verify") == 0 && argc == 2)
+		return dbftool_Verify(argv[1]);
+
+	dbftool_Usage();
+	return 2;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,660 @@
+/*****************************************************************************
+ * decode.c
+ *****************************************************************************
+ * Decodes the values stored in fields of dBASE files
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/* Exact powers of ten for scaling parsed numbers */
+static const double dbf_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+	1e21, 1e22
+};
+
+/* dbf_ParseNumber() {{{
+ * Parses a number as stored in 'N' and 'F' fields, surrounded by blanks,
+ * into its digits and the number of digits right of the decimal point.
+ * Returns 0 on success, 1 if the field is blank and -1 if it does not
+ * hold a plain decimal number or has more than 18 digits.
+ */
+int dbf_ParseNumber(const char *data, int len, int64_t *mantissa, int *scale)
+{
+	const char *end = data + len;
+	int64_t m = 0;
+	int neg = 0, digits = 0, frac = -1;
+
+	while (data < end && *data == ' ')
+		data++;
+	while (end > data && (end[-1] == ' ' || end[-1] == '\0'))
+		end--;
+	if (data == end)
+		return 1;
+
+	if (*data == '-' || *data == '+') {
+		neg = (*data == '-');
+		data++;
+	}
+	for (; data < end; data++) {
+		if (*data >= '0' && *data <= '9') {
+			if (++digits > 18)
+				return -1;
+			m = m * 10 + (*data - '0');
+			if (frac >= 0)
+				frac++;
+		} else if ((*data == '.' || *data == ',') && frac < 0) {
+			frac = 0;
+		} else {
+			return -1;
+		}
+	}
+	if (digits == 0)
+		return -1;
+
+	*mantissa = neg ? -m : m;
+	*scale = frac < 0 ? 0 : frac;
+	return 0;
+}
+/* }}} */
+
+/* dbf_ParseInt64() {{{
+ * Parses the integer part of a number field. Returns 0 on success, 1 if
+ * the field is blank and -1 if it is not a number.
+ */
+int dbf_ParseInt64(const char *data, int len, int64_t *value)
+{
+	int64_t m;
+	int scale, ret;
+
+	if (0 != (ret = dbf_ParseNumber(data, len, &m, &scale))) {
+		double d;
+
+		if (ret > 0 || 0 != dbf_ParseDouble(data, len, &d))
+			return ret;
+		*value = (int64_t) d;
+		return 0;
+	}
+	while (scale-- > 0)
+		m /= 10;
+	*value = m;
+	return 0;
+}
+/* }}} */
+
+/* dbf_ParseDouble() {{{
+ * Parses a number field into a double. Numbers whose digits fit into
+ * the 53 bits of a double are converted without calling strtod().
+ * Returns 0 on success, 1 if the field is blank and -1 if it is not
+ * a number.
+ */
+int dbf_ParseDouble(const char *data, int len, double *value)
+{
+	char buf[256], *end;
+	int64_t m;
+	int scale, ret;
+
+	if (0 == (ret = dbf_ParseNumber(data, len, &m, &scale)) &&
+		m < (1LL << 53) && m > -(1LL << 53)) {
+		*value = (double) m / dbf_pow10[scale];
+		return 0;
+	}
+	if (ret > 0)
+		return 1;
+
+	/* Exponents, '*' overflow markers and overlong numbers */
+	if (len > (int) sizeof(buf) - 1)
+		len = sizeof(buf) - 1;
+	memcpy(buf, data, len);
+	buf[len] = '\0';
+	*value = strtod(buf, &end);
+	if (end == buf)
+		return -1;
+	while (*end == ' ')
+		end++;
+	return *end == '\0' ? 0 : -1;
+}
+/* }}} */
+
+/* dbf_DaysFromCivil() {{{
+ * Returns the number of days between 1970-01-01 and the given date
+ */
+int32_t dbf_DaysFromCivil(int year, int month, int day)
+{
+	int era, yoe, doy, doe;
+
+	year -= month <= 2;
+	era = (year >= 0 ? year : year - 399) / 400;
+	yoe = year - era * 400;
+	doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+/* }}} */
+
+/* dbf_CivilFromDays() {{{
+ * Converts the number of days since 1970-01-01 into a date
+ */
+void dbf_CivilFromDays(int32_t days, int *year, int *month, int *day)
+{
+	int era, doe, yoe, doy, mp;
+
+	days += 719468;
+	era = (days >= 0 ? days : days - 146096) / 146097;
+	doe = days - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	*day = doy - (153 * mp + 2) / 5 + 1;
+	*month = mp < 10 ? mp + 3 : mp - 9;
+	*year = yoe + era * 400 + (*month <= 2);
+}
+/* }}} */
+
+/* dbf_ParseDate() {{{
+ * Parses a date field of the form YYYYMMDD into the number of days since
+ * 1970-01-01. Returns 0 on success, 1 if the field is blank and -1 if it
+ * is not a valid date.
+ */
+int dbf_ParseDate(const char *data, int len, int32_t *days)
+{
+	int i, year, month, day;
+
+	if (len < 8)
+		return -1;
+	for (i = 0; i < 8 && (data[i] == ' ' || data[i] == '\0'); i++)
+		;
+	if (i == 8)
+		return 1;
+	for (i = 0; i < 8; i++) {
+		if (data[i] < '0' || data[i] > '9')
+			return -1;
+	}
+
+	year = (data[0] - '0') * 1000 + (data[1] - '0') * 100 + (data[2] - '0') * 10 + (data[3] - '0');
+	month = (data[4] - '0') * 10 + (data[5] - '0');
+	day = (data[6] - '0') * 10 + (data[7] - '0');
+	if (month < 1 || month > 12 || day < 1 || day > 31)
+		return -1;
+
+	*days = dbf_DaysFromCivil(year, month, day);
+	return 0;
+}
+/* }}} */
+
+/* dbf_ParseLogical() {{{
+ * Parses a logical field. Returns 0 on success, 1 if the value is not
+ * initialized ('?' or blank) and -1 for other characters.
+ */
+int dbf_ParseLogical(const char *data, int len, int *value)
+{
+	if (len < 1)
+		return -1;
+
+	switch (data[0]) {
+		case 'T': case 't': case 'Y': case 'y':
+			*value = 1;
+			return 0;
+		case 'F': case 'f': case 'N': case 'n':
+			*value = 0;
+			return 0;
+		case '?': case ' ': case '\0':
+			return 1;
+		default:
+			return -1;
+	}
+}
+/* }}} */
+
+/* dbf_IsNull() {{{
+ * Checks the bit of the column in the _NullFlags field of Visual FoxPro
+ */
+int dbf_IsNull(P_DBF *p_dbf, const char *record, int column)
+{
+	int bit;
+
+	if (column < 0 || column >= (int) p_dbf->columns)
+		return -1;
+	if (NULL == p_dbf->null_bits || (bit = p_dbf->null_bits[column]) < 0)
+		return 0;
+
+	return (record[p_dbf->nullflags + bit / 8] >> (bit & 7)) & 1;
+}
+/* }}} */
+
+/* static dbf_FieldData() {{{
+ * Returns the field of the column within record or NULL if the column
+ * does not exist or is null.
+ */
+static const char *dbf_FieldData(P_DBF *p_dbf, const char *record, int column, int *ret)
+{
+	*ret = dbf_IsNull(p_dbf, record, column);
+	if (*ret != 0)
+		return NULL;
+
+	return record + p_dbf->fields[column].field_offset;
+}
+/* }}} */
+
+/* static dbf_BinaryField() {{{
+ * Returns the field of a binary column, or NULL and -1 in ret if the
+ * field does not have the width of its type
+ */
+static const char *dbf_BinaryField(P_DBF *p_dbf, const char *record, int column, int width, int *ret)
+{
+	const char *data = dbf_FieldData(p_dbf, record, column, ret);
+
+	if (data && p_dbf->fields[column].field_length != width) {
+		*ret = -1;
+		return NULL;
+	}
+
+	return data;
+}
+/* }}} */
+
+/* dbf_GetInt64() {{{
+ * Reads an integer from numeric, float, integer and currency fields.
+ * The binary fields of Visual FoxPro are loaded directly.
+ */
+int dbf_GetInt64(P_DBF *p_dbf, const char *record, int column, int64_t *value)
+{
+	const char *data;
+	int ret;
+
+	if (NULL == (data = dbf_FieldData(p_dbf, record, column, &ret)))
+		return ret;
+
+	switch (p_dbf->fields[column].field_type) {
+		case 'I':
+			if (NULL == (data = dbf_BinaryField(p_dbf, record, column, 4, &ret)))
+				return ret;
+			*value = (int32_t) dbf_Load32(data);
+			return 0;
+		case 'Y':
+			if (NULL == (data = dbf_BinaryField(p_dbf, record, column, 8, &ret)))
+				return ret;
+			*value = (int64_t) dbf_Load64(data) / 10000;
+			return 0;
+		case 'N':
+		case 'F':
+			return dbf_ParseInt64(data, p_dbf->fields[column].field_length, value);
+		default:
+			return -1;
+	}
+}
+/* }}} */
+
+/* dbf_GetDouble() {{{
+ * Reads a floating point number from numeric, float, double, integer
+ * and currency fields.
+ */
+int dbf_GetDouble(P_DBF *p_dbf, const char *record, int column, double *value)
+{
+	const char *data;
+	u_int64_t bits;
+	int ret;
+
+	if (NULL == (data = dbf_FieldData(p_dbf, record, column, &ret)))
+		return ret;
+
+	switch (p_dbf->fields[column].field_type) {
+		case 'B':
+			/* dBASE uses B for memo fields */
+			if (NULL == (data = dbf_BinaryField(p_dbf, record, column, 8, &ret)))
+				return ret;
+			bits = dbf_Load64(data);
+			memcpy(value, &bits, 8);
+			return 0;
+		case 'I':
+			if (NULL == (data = dbf_BinaryField(p_dbf, record, column, 4, &ret)))
+				return ret;
+			*value = (int32_t) dbf_Load32(data);
+			return 0;
+		case 'Y':
+			if (NULL == (data = dbf_BinaryField(p_dbf, record, column, 8, &ret)))
+				return ret;
+			*value = (double) (int64_t) dbf_Load64(data) / 10000;
+			return 0;
+		case 'N':
+		case 'F':
+			return dbf_ParseDouble(data, p_dbf->fields[column].field_length, value);
+		default:
+			return -1;
+	}
+}
+/* }}} */
+
+/* dbf_GetCurrency() {{{
+ * Reads a currency field as integer in units of 1/10000
+ */
+int dbf_GetCurrency(P_DBF *p_dbf, const char *record, int column, int64_t *value)
+{
+	const char *data;
+	int64_t m;
+	int ret, scale;
+
+	if (NULL == (data = dbf_FieldData(p_dbf, record, column, &ret)))
+		return ret;
+
+	switch (p_dbf->fields[column].field_type) {
+		case 'Y':
+			if (NULL == (data = dbf_BinaryField(p_dbf, record, column, 8, &ret)))
+				return ret;
+			*value = (int64_t) dbf_Load64(data);
+			return 0;
+		case 'I':
+			if (NULL == (data = dbf_BinaryField(p_dbf, record, column, 4, &ret)))
+				return ret;
+			*value = (int64_t) (int32_t) dbf_Load32(data) * 10000;
+			return 0;
+		case 'N':
+		case 'F':
+			if (0 != (ret = dbf_ParseNumber(data, p_dbf->fields[column].field_length, &m, &scale)))
+				return ret;
+			for (; scale < 4; scale++)
+				m *= 10;
+			for (; scale > 4; scale--)
+				m /= 10;
+			*value = m;
+			return 0;
+		default:
+			return -1;
+	}
+}
+/* }}} */
+
+/* dbf_GetDateTime() {{{
+ * Reads a date or datetime field as milliseconds since 1970-01-01
+ */
+int dbf_GetDateTime(P_DBF *p_dbf, const char *record, int column, int64_t *msec)
+{
+	const char *data;
+	int32_t days, julian, ms;
+	int ret;
+
+	if (NULL == (data = dbf_FieldData(p_dbf, record, column, &ret)))
+		return ret;
+
+	switch (p_dbf->fields[column].field_type) {
+		case 'T':
+			if (NULL == (data = dbf_BinaryField(p_dbf, record, column, 8, &ret)))
+				return ret;
+			julian = (int32_t) dbf_Load32(data);
+			ms = (int32_t) dbf_Load32(data + 4);
+			if (julian == 0 && ms == 0)
+				return 1;
+			*msec = (int64_t) (julian - DBF_JULIAN_EPOCH) * 86400000 + ms;
+			return 0;
+		case 'D':
+			if (0 != (ret = dbf_ParseDate(data, p_dbf->fields[column].field_length, &days)))
+				return ret;
+			*msec = (int64_t) days * 86400000;
+			return 0;
+		default:
+			return -1;
+	}
+}
+/* }}} */
+
+/* static dbf_DecodeString() {{{
+ */
+static void dbf_DecodeString(const char *data, int len, DBF_VALUE *value)
+{
+	while (len > 0 && (data[len-1] == ' ' || data[len-1] == '\0'))
+		len--;
+	value->v.str.data = data;
+	value->v.str.len = len;
+}
+/* }}} */
+
+/* static dbf_DecodeRaw() {{{
+ * Binary fields keep trailing blanks and zeros
+ */
+static void dbf_DecodeRaw(const char *data, int len, DBF_VALUE *value)
+{
+	value->v.str.data = data;
+	value->v.str.len = len;
+}
+/* }}} */
+
+/* static dbf_DecodeFailed() {{{
+ * Returns blank fields as null and others which cannot be parsed as string
+ */
+static void dbf_DecodeFailed(const char *data, int len, DBF_VALUE *value, int ret)
+{
+	if (ret > 0) {
+		value->type = DBF_VALUE_NULL;
+		return;
+	}
+	value->type = DBF_VALUE_STRING;
+	dbf_DecodeString(data, len, value);
+}
+/* }}} */
+
+/* static dbf_DecodeInt() {{{
+ */
+static void dbf_DecodeInt(const char *data, int len, DBF_VALUE *value)
+{
+	int ret;
+
+	if (0 != (ret = dbf_ParseInt64(data, len, &value->v.i)))
+		dbf_DecodeFailed(data, len, value, ret);
+}
+/* }}} */
+
+/* static dbf_DecodeDouble() {{{
+ */
+static void dbf_DecodeDouble(const char *data, int len, DBF_VALUE *value)
+{
+	int ret;
+
+	if (0 != (ret = dbf_ParseDouble(data, len, &value->v.d)))
+		dbf_DecodeFailed(data, len, value, ret);
+}
+/* }}} */
+
+/* static dbf_DecodeDate() {{{
+ */
+static void dbf_DecodeDate(const char *data, int len, DBF_VALUE *value)
+{
+	int ret;
+
+	if (0 != (ret = dbf_ParseDate(data, len, &value->v.days)))
+		dbf_DecodeFailed(data, len, value, ret);
+}
+/* }}} */
+
+/* static dbf_DecodeLogical() {{{
+ */
+static void dbf_DecodeLogical(const char *data, int len, DBF_VALUE *value)
+{
+	int ret;
+
+	if (0 != (ret = dbf_ParseLogical(data, len, &value->v.b)))
+		dbf_DecodeFailed(data, len, value, ret);
+}
+/* }}} */
+
+/* static dbf_DecodeInt32() {{{
+ */
+static void dbf_DecodeInt32(const char *data, int len, DBF_VALUE *value)
+{
+	value->v.i = (int32_t) dbf_Load32(data);
+}
+/* }}} */
+
+/* static dbf_DecodeBinDouble() {{{
+ */
+static void dbf_DecodeBinDouble(const char *data, int len, DBF_VALUE *value)
+{
+	u_int64_t bits = dbf_Load64(data);
+
+	memcpy(&value->v.d, &bits, 8);
+}
+/* }}} */
+
+/* static dbf_DecodeCurrency() {{{
+ */
+static void dbf_DecodeCurrency(const char *data, int len, DBF_VALUE *value)
+{
+	value->v.i = (int64_t) dbf_Load64(data);
+}
+/* }}} */
+
+/* static dbf_DecodeDateTime() {{{
+ */
+static void dbf_DecodeDateTime(const char *data, int len, DBF_VALUE *value)
+{
+	int32_t julian = (int32_t) dbf_Load32(data);
+	int32_t ms = (int32_t) dbf_Load32(data + 4);
+
+	if (julian == 0 && ms == 0)
+		value->type = DBF_VALUE_NULL;
+	else
+		value->v.i = (int64_t) (julian - DBF_JULIAN_EPOCH) * 86400000 + ms;
+}
+/* }}} */
+
+/* dbf_BuildPlan() {{{
+ * Chooses the decoder of each column. The arrays of the plan are
+ * allocated together with it in one block.
+ */
+int dbf_BuildPlan(P_DBF *p_dbf)
+{
+	DBF_PLAN *plan;
+	DB_FIELD *field;
+	int i, n = p_dbf->columns;
+
+	if (p_dbf->plan) {
+		free(p_dbf->plan);
+		p_dbf->plan = NULL;
+	}
+	plan = malloc(sizeof(DBF_PLAN) + n * (sizeof(DBF_DECODER) + sizeof(u_int32_t) + sizeof(int) + 1));
+	if (NULL == plan)
+		return -1;
+	plan->decode = (DBF_DECODER *) (plan + 1);
+	plan->offset = (u_int32_t *) (plan->decode + n);
+	plan->length = (int *) (plan->offset + n);
+	plan->type = (unsigned char *) (plan->length + n);
+
+	for (i = 0; i < n; i++) {
+		field = &p_dbf->fields[i];
+		plan->offset[i] = field->field_offset;
+		plan->length[i] = field->field_length;
+		plan->type[i] = DBF_VALUE_STRING;
+		plan->decode[i] = dbf_DecodeString;
+
+		switch (field->field_type) {
+			case 'N':
+				if (field->field_decimals == 0 && field->field_length <= 18) {
+					plan->type[i] = DBF_VALUE_INT;
+					plan->decode[i] = dbf_DecodeInt;
+					break;
+				}
+				/* fall through */
+			case 'F':
+				plan->type[i] = DBF_VALUE_DOUBLE;
+				plan->decode[i] = dbf_DecodeDouble;
+				break;
+			case 'D':
+				plan->type[i] = DBF_VALUE_DATE;
+				plan->decode[i] = dbf_DecodeDate;
+				break;
+			case 'L':
+				plan->type[i] = DBF_VALUE_BOOL;
+				plan->decode[i] = dbf_DecodeLogical;
+				break;
+			case 'I':
+				if (field->field_length == 4) {
+					plan->type[i] = DBF_VALUE_INT;
+					plan->decode[i] = dbf_DecodeInt32;
+				}
+				break;
+			case 'B':
+				/* dBASE uses B for memo fields */
+				if (field->field_length == 8) {
+					plan->type[i] = DBF_VALUE_DOUBLE;
+					plan->decode[i] = dbf_DecodeBinDouble;
+				}
+				break;
+			case 'Y':
+				if (field->field_length == 8) {
+					plan->type[i] = DBF_VALUE_CURRENCY;
+					plan->decode[i] = dbf_DecodeCurrency;
+				}
+				break;
+			case 'T':
+				if (field->field_length == 8) {
+					plan->type[i] = DBF_VALUE_DATETIME;
+					plan->decode[i] = dbf_DecodeDateTime;
+				}
+				break;
+			case 'M':
+			case 'G':
+			case 'P':
+				/* Visual FoxPro stores block numbers as 4 byte integers,
+				 * dBASE as 10 digits */
+				if (field->field_length == 4) {
+					plan->type[i] = DBF_VALUE_INT;
+					plan->decode[i] = dbf_DecodeInt32;
+				}
+				break;
+			case 'Q':
+			case '0':
+				plan->decode[i] = dbf_DecodeRaw;
+				break;
+		}
+	}
+	p_dbf->plan = plan;
+
+	return 0;
+}
+/* }}} */
+
+/* dbf_DecodeRecord() {{{
+ * Decodes all fields of a record following the plan of the table
+ */
+int dbf_DecodeRecord(P_DBF *p_dbf, const char *record, DBF_VALUE *values)
+{
+	const DBF_PLAN *plan = p_dbf->plan;
+	int i, n = p_dbf->columns;
+
+	if (NULL == plan)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		values[i].type = plan->type[i];
+		plan->decode[i](record + plan->offset[i], plan->length[i], &values[i]);
+	}
+
+	if (p_dbf->null_bits) {
+		for (i = 0; i < n; i++) {
+			if (dbf_IsNull(p_dbf, record, i) == 1)
+				values[i].type = DBF_VALUE_NULL;
+		}
+	}
+
+	return n;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
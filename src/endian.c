@@ -10,6 +10,7 @@
  * $Id$
  ****************************************************************************/
 
+#include "config.h"
 #include "endian.h"
 
 /*******************************************************************
@@ -19,14 +20,10 @@
  *******************************************************************/
 
 /* rotate2b() {{{
- * swap 4 byte integers
+ * swap 2 byte integers
  */
 u_int16_t rotate2b(u_int16_t var) {
-	u_int16_t tmp;
-	unsigned char *ptmp;
-	tmp = var;
-	ptmp = (unsigned char *) &tmp;
-	return(((u_int16_t) ptmp[1] << 8) + (u_int16_t) ptmp[0]);
+	return dbf_LE16(var);
 }
 /* }}} */
 
@@ -34,11 +31,36 @@ u_int16_t rotate2b(u_int16_t var) {
  * swap 4 byte integers
  */
 u_int32_t rotate4b(u_int32_t var) {
-	u_int32_t tmp;
-	unsigned char *ptmp;
-	tmp = var;
-	ptmp = (unsigned char *) &tmp;
-	return(((u_int32_t) ptmp[3] << 24) + ((u_int32_t) ptmp[2] << 16) + ((u_int32_t) ptmp[1] << 8) + (u_int32_t) ptmp[0]);
+	return dbf_LE32(var);
+}
+/* }}} */
+
+/* dbf_SwapLE32() {{{
+ * Converts n 4 byte values between little endian and host order. The
+ * simple loop is vectorized by the compiler on big endian hosts.
+ */
+void dbf_SwapLE32(void *data, size_t n) {
+#ifdef DBF_BIG_ENDIAN
+	u_int32_t *v = data;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		v[i] = dbf_Swap32(v[i]);
+#endif
+}
+/* }}} */
+
+/* dbf_SwapLE64() {{{
+ * Converts n 8 byte values between little endian and host order
+ */
+void dbf_SwapLE64(void *data, size_t n) {
+#ifdef DBF_BIG_ENDIAN
+	u_int64_t *v = data;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		v[i] = dbf_Swap64(v[i]);
+#endif
 }
 /* }}} */
 
@@ -19,6 +19,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 
 #ifdef __unix__   
@@ -39,14 +40,101 @@
     #define __ANUBISNET_TYPES__
       typedef UINT32 u_int32_t; 
       typedef unsigned short u_int16_t;
+      typedef UINT64 u_int64_t;
+    #endif
+    #ifdef _MSC_VER
+      #define inline __inline
     #endif
 #else
    #include <sys/types.h>
 #endif
 
-/* 
- * F U N C T I O N S 
+/*
+ * B Y T E   O R D E R
+ *
+ * The byte order of the host is known at compile time, either from
+ * configure or from the compiler. dBASE files are little endian, so on
+ * little endian hosts all conversions below compile to plain loads.
  */
+#if defined(WORDS_BIGENDIAN) || \
+	(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define DBF_BIG_ENDIAN 1
+#endif
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+#define dbf_Swap16(v) __builtin_bswap16(v)
+#define dbf_Swap32(v) __builtin_bswap32(v)
+#define dbf_Swap64(v) __builtin_bswap64(v)
+#else
+#define dbf_Swap16(v) ((u_int16_t) ((((v) & 0xFF) << 8) | (((v) >> 8) & 0xFF)))
+#define dbf_Swap32(v) \
+	((((v) & 0xFF) << 24) | (((v) & 0xFF00) << 8) | \
+	 (((v) >> 8) & 0xFF00) | (((v) >> 24) & 0xFF))
+#define dbf_Swap64(v) \
+	(((u_int64_t) dbf_Swap32((u_int32_t) (v)) << 32) | \
+	 dbf_Swap32((u_int32_t) ((v) >> 32)))
+#endif
+
+/* Conversion between little endian and host order, in both directions */
+#ifdef DBF_BIG_ENDIAN
+#define dbf_LE16(v) dbf_Swap16(v)
+#define dbf_LE32(v) dbf_Swap32(v)
+#define dbf_LE64(v) dbf_Swap64(v)
+#else
+#define dbf_LE16(v) ((u_int16_t) (v))
+#define dbf_LE32(v) ((u_int32_t) (v))
+#define dbf_LE64(v) ((u_int64_t) (v))
+#endif
+
+/*
+ * F U N C T I O N S
+ */
+
+/* Loads and stores of little endian integers at unaligned addresses */
+static inline u_int16_t dbf_Load16(const void *p)
+{
+	u_int16_t v;
+	memcpy(&v, p, 2);
+	return dbf_LE16(v);
+}
+
+static inline u_int32_t dbf_Load32(const void *p)
+{
+	u_int32_t v;
+	memcpy(&v, p, 4);
+	return dbf_LE32(v);
+}
+
+static inline u_int64_t dbf_Load64(const void *p)
+{
+	u_int64_t v;
+	memcpy(&v, p, 8);
+	return dbf_LE64(v);
+}
+
+static inline void dbf_Store16(void *p, u_int16_t v)
+{
+	v = dbf_LE16(v);
+	memcpy(p, &v, 2);
+}
+
+static inline void dbf_Store32(void *p, u_int32_t v)
+{
+	v = dbf_LE32(v);
+	memcpy(p, &v, 4);
+}
+
+static inline void dbf_Store64(void *p, u_int64_t v)
+{
+	v = dbf_LE64(v);
+	memcpy(p, &v, 8);
+}
+
+/* Converts arrays of little endian values in place, no-ops on little endian hosts */
+void dbf_SwapLE32(void *data, size_t n);
+void dbf_SwapLE64(void *data, size_t n);
+
+/* Out-of-line versions kept for programs using them */
 u_int16_t rotate2b ( u_int16_t var );
 u_int32_t rotate4b ( u_int32_t var );
 
@@ -0,0 +1,385 @@
+/*****************************************************************************
+ * export.c
+ *****************************************************************************
+ * Exports dBASE files into other formats
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/*
+ * The records are split into chunks of about DBF_BLOCK_SIZE bytes. A
+ * batch of chunks is read and formatted in parallel, each chunk into its
+ * own buffer, before the buffers are written in the order of the records.
+ * Text fields are copied as they are stored, the binary fields of Visual
+ * FoxPro are decoded by the plan of the table and formatted.
+ */
+
+/* how a column is written */
+#define DBF_CSV_TEXT 0
+#define DBF_CSV_BINARY 1
+#define DBF_CSV_SKIP 2
+
+/* longest formatted binary field */
+#define DBF_CSV_BINARY_LEN 32
+
+struct dbf_CSV {
+	P_DBF *p_dbf;
+	int flags;
+	char delimiter;
+	/* DBF_CSV_TEXT, DBF_CSV_BINARY or DBF_CSV_SKIP per column */
+	unsigned char *mode;
+	/* records per chunk */
+	u_int32_t chunkrecs;
+	/* first chunk of the current batch */
+	u_int32_t first;
+	/* per chunk of a batch: raw records, formatted output and its length */
+	char **raw;
+	char **out;
+	size_t *outlen;
+	/* number of records written per chunk, -1 on error */
+	long *written;
+};
+
+/* dbf_WriteAll() {{{
+ * Writes len bytes into fd, continuing after partial writes
+ */
+int dbf_WriteAll(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, buf, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+/* }}} */
+
+/* static dbf_CSVField() {{{
+ * Appends one field to out with leading and trailing blanks removed.
+ * The field is quoted if it contains the delimiter, quotes or line breaks.
+ * Returns the position behind the field.
+ */
+static char *dbf_CSVField(struct dbf_CSV *csv, const char *data, int len, int transcode, char *out)
+{
+	const char *p;
+	char *start;
+	int quote = 0;
+
+	while (len > 0 && (data[len-1] == ' ' || data[len-1] == '\0'))
+		len--;
+	while (len > 0 && data[0] == ' ') {
+		data++;
+		len--;
+	}
+
+	for (p = data; p < data + len; p++) {
+		if (*p == csv->delimiter || *p == '"' || *p == '\n' || *p == '\r') {
+			quote = 1;
+			break;
+		}
+	}
+
+	if (quote)
+		*out++ = '"';
+	start = out;
+	if (transcode)
+		out += dbf_ToUTF8(csv->p_dbf, data, len, out);
+	else {
+		memcpy(out, data, len);
+		out += len;
+	}
+	if (quote) {
+		int quotes = 0;
+		char *q;
+
+		for (q = start; q < out; q++)
+			quotes += (*q == '"');
+		/* Double all quotes, working backwards to move the data once */
+		if (quotes) {
+			char *src = out - 1, *dst = out + quotes - 1;
+			out += quotes;
+			while (src >= start) {
+				*dst-- = *src;
+				if (*src == '"')
+					*dst-- = '"';
+				src--;
+			}
+		}
+		*out++ = '"';
+	}
+
+	return out;
+}
+/* }}} */
+
+/* static dbf_CSVMode() {{{
+ * Returns how the column is written. _NullFlags is left out.
+ */
+static int dbf_CSVMode(DB_FIELD *field)
+{
+	switch (field->field_type) {
+		case '0':
+			if (field->field_flags & DBF_FIELD_SYSTEM)
+				return DBF_CSV_SKIP;
+			break;
+		case 'I':
+		case 'M':
+		case 'G':
+		case 'P':
+			if (field->field_length == 4)
+				return DBF_CSV_BINARY;
+			break;
+		case 'B':
+		case 'Y':
+		case 'T':
+			if (field->field_length == 8)
+				return DBF_CSV_BINARY;
+			break;
+	}
+
+	return DBF_CSV_TEXT;
+}
+/* }}} */
+
+/* static dbf_CSVBinary() {{{
+ * Decodes a binary field and formats its value into out. Returns the
+ * position behind the value.
+ */
+static char *dbf_CSVBinary(P_DBF *p_dbf, const char *record, int col, char *out)
+{
+	const DBF_PLAN *plan = p_dbf->plan;
+	DBF_VALUE v;
+	int64_t ms, c;
+	int32_t days;
+	int year, month, day, n = 0;
+
+	v.type = plan->type[col];
+	plan->decode[col](record + plan->offset[col], plan->length[col], &v);
+
+	switch (v.type) {
+		case DBF_VALUE_INT:
+			n = snprintf(out, DBF_CSV_BINARY_LEN, "%lld", (long long) v.v.i);
+			break;
+		case DBF_VALUE_DOUBLE:
+			n = snprintf(out, DBF_CSV_BINARY_LEN, "%.17g", v.v.d);
+			break;
+		case DBF_VALUE_CURRENCY:
+			c = v.v.i < 0 ? -v.v.i : v.v.i;
+			n = snprintf(out, DBF_CSV_BINARY_LEN, "%s%lld.%04d", v.v.i < 0 ? "-" : "",
+				(long long) (c / 10000), (int) (c % 10000));
+			break;
+		case DBF_VALUE_DATETIME:
+			days = (int32_t) ((v.v.i >= 0 ? v.v.i : v.v.i - 86399999) / 86400000);
+			ms = v.v.i - (int64_t) days * 86400000;
+			dbf_CivilFromDays(days, &year, &month, &day);
+			n = snprintf(out, DBF_CSV_BINARY_LEN, "%04d-%02d-%02d %02d:%02d:%02d", year, month, day,
+				(int) (ms / 3600000), (int) (ms / 60000 % 60), (int) (ms / 1000 % 60));
+			break;
+	}
+	if (n < 0 || n >= DBF_CSV_BINARY_LEN)
+		n = 0;
+
+	return out + n;
+}
+/* }}} */
+
+/* static dbf_CSVChunk() {{{
+ * Reads and formats one chunk of a batch
+ */
+static void dbf_CSVChunk(void *ctx, int task, int worker)
+{
+	struct dbf_CSV *csv = ctx;
+	P_DBF *p_dbf = csv->p_dbf;
+	u_int32_t reclen = p_dbf->header->record_length;
+	const char *records, *rec;
+	char *out;
+	int n, i, col, transcode, first;
+	long lines = 0;
+
+	csv->written[task] = -1;
+	n = dbf_ReadBlock(p_dbf, (csv->first + task) * csv->chunkrecs, csv->chunkrecs, csv->raw[task], &records);
+	if (n < 0)
+		return;
+
+	out = csv->out[task];
+	for (i = 0; i < n; i++) {
+		rec = records + i * reclen;
+		if ((p_dbf->scan_options & DBF_SKIP_DELETED) && rec[0] == '*')
+			continue;
+		for (col = 0, first = 1; col < (int) p_dbf->columns; col++) {
+			if (csv->mode[col] == DBF_CSV_SKIP)
+				continue;
+			if (!first)
+				*out++ = csv->delimiter;
+			first = 0;
+			/* Null fields are left empty */
+			if (p_dbf->null_bits && dbf_IsNull(p_dbf, rec, col) == 1)
+				continue;
+			if (csv->mode[col] == DBF_CSV_BINARY) {
+				out = dbf_CSVBinary(p_dbf, rec, col, out);
+				continue;
+			}
+			transcode = (csv->flags & DBF_CSV_UTF8) && p_dbf->fields[col].field_type == 'C';
+			out = dbf_CSVField(csv, rec + p_dbf->fields[col].field_offset,
+				p_dbf->fields[col].field_length, transcode, out);
+		}
+		*out++ = '\r';
+		*out++ = '\n';
+		lines++;
+	}
+	csv->outlen[task] = out - csv->out[task];
+	csv->written[task] = lines;
+}
+/* }}} */
+
+/* dbf_ExportCSV() {{{
+ * Writes all records as comma separated values into fd
+ */
+long dbf_ExportCSV(P_DBF *p_dbf, int fd, char delimiter, int flags, int threads)
+{
+	struct dbf_CSV csv;
+	u_int32_t reclen = p_dbf->header->record_length;
+	u_int32_t nrecs = p_dbf->header->records;
+	u_int32_t nchunks, batch = 0, i;
+	size_t linelen;
+	long total = 0;
+	int col, fieldlen, first, ret = -1;
+	char *line;
+
+	if (reclen == 0 || NULL == p_dbf->plan)
+		return -1;
+
+	memset(&csv, 0, sizeof(csv));
+	csv.p_dbf = p_dbf;
+	csv.flags = flags;
+	csv.delimiter = delimiter;
+
+	/* Builds the translation table once before threads use it */
+	if ((flags & DBF_CSV_UTF8) && dbf_ToUTF8(p_dbf, "", 0, (char *) &col) < 0)
+		return -1;
+	if (NULL == (csv.mode = malloc(p_dbf->columns)))
+		return -1;
+
+	/* Longest possible line: every character quoted and transcoded */
+	linelen = 2;
+	for (col = 0; col < (int) p_dbf->columns; col++) {
+		csv.mode[col] = dbf_CSVMode(&p_dbf->fields[col]);
+		fieldlen = p_dbf->fields[col].field_length;
+		if (fieldlen < 11)
+			fieldlen = 11;
+		if (csv.mode[col] == DBF_CSV_BINARY)
+			fieldlen = DBF_CSV_BINARY_LEN;
+		linelen += fieldlen * ((flags & DBF_CSV_UTF8) ? 6 : 2) + 3;
+	}
+
+	if (flags & DBF_CSV_HEADER) {
+		char *out;
+
+		if (NULL == (line = malloc(linelen)))
+			goto cleanup;
+		out = line;
+		for (col = 0, first = 1; col < (int) p_dbf->columns; col++) {
+			const char *name = (const char *) p_dbf->fields[col].field_name;
+			if (csv.mode[col] == DBF_CSV_SKIP)
+				continue;
+			if (!first)
+				*out++ = delimiter;
+			first = 0;
+			out = dbf_CSVField(&csv, name, strnlen(name, 11), 0, out);
+		}
+		*out++ = '\r';
+		*out++ = '\n';
+		if (dbf_WriteAll(fd, line, out - line) < 0) {
+			free(line);
+			goto cleanup;
+		}
+		free(line);
+	}
+
+	csv.chunkrecs = DBF_BLOCK_SIZE / reclen;
+	if (csv.chunkrecs == 0)
+		csv.chunkrecs = 1;
+	nchunks = (nrecs + csv.chunkrecs - 1) / csv.chunkrecs;
+	threads = dbf_TableThreads(p_dbf, threads);
+	batch = threads * 2;
+	if (batch > nchunks)
+		batch = nchunks;
+	if (batch == 0) {
+		ret = 0;
+		goto cleanup;
+	}
+
+	csv.raw = calloc(batch, sizeof(char *));
+	csv.out = calloc(batch, sizeof(char *));
+	csv.outlen = calloc(batch, sizeof(size_t));
+	csv.written = calloc(batch, sizeof(long));
+	if (!csv.raw || !csv.out || !csv.outlen || !csv.written)
+		goto cleanup;
+	for (i = 0; i < batch; i++) {
+		if (NULL == p_dbf->mem && NULL == (csv.raw[i] = malloc(csv.chunkrecs * reclen)))
+			goto cleanup;
+		if (NULL == (csv.out[i] = malloc(csv.chunkrecs * linelen)))
+			goto cleanup;
+	}
+
+	for (csv.first = 0; csv.first < nchunks; csv.first += batch) {
+		u_int32_t count = nchunks - csv.first < batch ? nchunks - csv.first : batch;
+
+		dbf_RunTasks(threads, count, dbf_CSVChunk, &csv);
+		for (i = 0; i < count; i++) {
+			if (csv.written[i] < 0)
+				goto cleanup;
+			if (dbf_WriteAll(fd, csv.out[i], csv.outlen[i]) < 0)
+				goto cleanup;
+			total += csv.written[i];
+		}
+	}
+	ret = 0;
+
+cleanup:
+	for (i = 0; i < batch; i++) {
+		if (csv.raw && csv.raw[i])
+			free(csv.raw[i]);
+		if (csv.out && csv.out[i])
+			free(csv.out[i]);
+	}
+	if (csv.raw)
+		free(csv.raw);
+	if (csv.out)
+		free(csv.out);
+	if (csv.outlen)
+		free(csv.outlen);
+	if (csv.written)
+		free(csv.written);
+	free(csv.mode);
+
+	return ret < 0 ? -1 : total;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
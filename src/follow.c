@@ -0,0 +1,143 @@
+/*****************************************************************************
+ * follow.c
+ *****************************************************************************
+ * Reads records as they are appended to dBASE files
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+#if defined(HAVE_SYS_INOTIFY_H) && defined(HAVE_POLL_H)
+#include <sys/inotify.h>
+#include <poll.h>
+#define DBF_INOTIFY 1
+#endif
+
+/* interval to check the header without inotify, in milliseconds */
+#define DBF_FOLLOW_INTERVAL 100
+
+/* dbf_Follow() {{{
+ * Passes the records appended since record *next to the callback
+ */
+long dbf_Follow(P_DBF *p_dbf, u_int32_t *next, DBF_FOLLOW callback, void *ctx)
+{
+	u_int32_t reclen = p_dbf->header->record_length;
+	u_int32_t blockrecs, first;
+	const char *records;
+	char *buf = NULL;
+	long total = 0;
+	int records_now, n;
+
+	if (reclen == 0 || 0 > (records_now = dbf_Refresh(p_dbf)))
+		return -1;
+	/* The table has been packed or replaced */
+	if ((u_int32_t) records_now < *next)
+		return -1;
+	if ((u_int32_t) records_now == *next)
+		return 0;
+
+	blockrecs = DBF_BLOCK_SIZE / reclen;
+	if (blockrecs == 0)
+		blockrecs = 1;
+	if (NULL == p_dbf->mem && NULL == (buf = malloc((size_t) blockrecs * reclen)))
+		return -1;
+
+	for (first = *next; first < (u_int32_t) records_now; first += n) {
+		if (0 >= (n = dbf_ReadBlock(p_dbf, first, blockrecs, buf, &records))) {
+			if (n < 0)
+				total = -1;
+			break;
+		}
+		total += n;
+		*next = first + n;
+		if (callback(ctx, first, records, n))
+			break;
+	}
+
+	if (buf)
+		free(buf);
+
+	return total;
+}
+/* }}} */
+
+/* dbf_FollowWait() {{{
+ * Waits until there are more than next records
+ */
+int dbf_FollowWait(P_DBF *p_dbf, u_int32_t next, int timeout)
+{
+	int records, waited = 0;
+#ifdef DBF_INOTIFY
+	struct pollfd pfd;
+	char events[4096];
+	int fd = -1, ret;
+
+	/* Stdin and memory buffers are polled like on systems without inotify */
+	if (p_dbf->filename && NULL == p_dbf->mem &&
+		(fd = inotify_init()) != -1 &&
+		inotify_add_watch(fd, p_dbf->filename, IN_MODIFY) == -1) {
+		close(fd);
+		fd = -1;
+	}
+#endif
+
+	for (;;) {
+		/* Records appended before the watch was added are not missed */
+		if (0 > (records = dbf_Refresh(p_dbf)))
+			break;
+		if ((u_int32_t) records > next || (timeout >= 0 && waited >= timeout))
+			break;
+#ifdef DBF_INOTIFY
+		if (fd != -1) {
+			pfd.fd = fd;
+			pfd.events = POLLIN;
+			if (0 > (ret = poll(&pfd, 1, timeout < 0 ? -1 : timeout - waited))) {
+				if (errno == EINTR)
+					continue;
+				records = -1;
+				break;
+			}
+			if (ret == 0) {
+				waited = timeout;
+				continue;
+			}
+			if (read(fd, events, sizeof(events)) == -1 && errno != EINTR) {
+				records = -1;
+				break;
+			}
+			continue;
+		}
+#endif
+		usleep(DBF_FOLLOW_INTERVAL * 1000);
+		waited += DBF_FOLLOW_INTERVAL;
+	}
+
+#ifdef DBF_INOTIFY
+	if (fd != -1)
+		close(fd);
+#endif
+	if (records < 0)
+		return -1;
+
+	return (u_int32_t) records > next;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,285 @@
+/*****************************************************************************
+ * join.c
+ *****************************************************************************
+ * Joins two dBASE files on a key column
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/*
+ * All records of the build table are held in memory, or used in place
+ * for tables opened by dbf_OpenMemory(). The hash table only stores
+ * record numbers: one chain per bucket, linked through an array with
+ * one entry per record. The probe table is read in chunks of about
+ * DBF_BLOCK_SIZE bytes by several threads, which look up the keys
+ * within the records they have read.
+ */
+
+/* end of a chain */
+#define DBF_JOIN_END 0xFFFFFFFFU
+
+/* blanks stripped from keys: none for binary fields, the padding of
+ * text and dates, and leading blanks of numbers as well */
+#define DBF_JOIN_TRIM_NONE 0
+#define DBF_JOIN_TRIM_RIGHT 1
+#define DBF_JOIN_TRIM_BOTH 2
+
+struct dbf_Join {
+	P_DBF *build;
+	P_DBF *probe;
+	const char *records;
+	int buildcol, probecol;
+	u_int32_t buildoff, probeoff;
+	int buildlen, probelen;
+	int buildtrim, probetrim;
+	/* first record of each bucket, next record of each record */
+	u_int32_t *heads;
+	u_int32_t *next;
+	u_int32_t *hashes;
+	u_int32_t mask;
+	/* records per chunk of the probe table */
+	u_int32_t chunkrecs;
+	DBF_JOIN callback;
+	void *ctx;
+	/* per worker: buffer of a chunk and number of pairs */
+	char **raw;
+	long *count;
+	/* shared by the workers */
+	DBF_FLAG failed;
+	DBF_FLAG stop;
+};
+
+/* static dbf_JoinTrim() {{{
+ * Returns how the keys of a column are trimmed. The binary fields of
+ * Visual FoxPro are compared at their full width, since blanks and zero
+ * bytes are part of their values.
+ */
+static int dbf_JoinTrim(DB_FIELD *field)
+{
+	switch (field->field_type) {
+		case 'N':
+		case 'F':
+			return DBF_JOIN_TRIM_BOTH;
+		case 'C':
+		case 'D':
+			return DBF_JOIN_TRIM_RIGHT;
+	}
+
+	return DBF_JOIN_TRIM_NONE;
+}
+/* }}} */
+
+/* static dbf_JoinKey() {{{
+ * Strips the blanks which pad the key. Numbers are aligned right, so
+ * leading blanks are stripped as well.
+ */
+static const char *dbf_JoinKey(const char *data, int *len, int trim)
+{
+	if (trim == DBF_JOIN_TRIM_NONE)
+		return data;
+	while (*len > 0 && (data[*len - 1] == ' ' || data[*len - 1] == '\0'))
+		(*len)--;
+	if (trim == DBF_JOIN_TRIM_BOTH) {
+		while (*len > 0 && *data == ' ') {
+			data++;
+			(*len)--;
+		}
+	}
+
+	return data;
+}
+/* }}} */
+
+/* static dbf_JoinHash() {{{
+ * FNV-1a hash of a key
+ */
+static u_int32_t dbf_JoinHash(const char *key, int len)
+{
+	u_int32_t h = 2166136261U;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char) key[i];
+		h *= 16777619U;
+	}
+
+	return h;
+}
+/* }}} */
+
+/* static dbf_JoinChunk() {{{
+ * Reads one chunk of the probe table and looks up its keys
+ */
+static void dbf_JoinChunk(void *ctx, int task, int worker)
+{
+	struct dbf_Join *j = ctx;
+	u_int32_t reclen = j->probe->header->record_length;
+	u_int32_t buildlen = j->build->header->record_length;
+	u_int32_t first = task * j->chunkrecs, r, hash;
+	const char *records, *rec, *key, *bkey;
+	int n, i, len, blen;
+
+	if (j->failed || j->stop)
+		return;
+	if (0 > (n = dbf_ReadBlock(j->probe, first, j->chunkrecs, j->raw[worker], &records))) {
+		j->failed = 1;
+		return;
+	}
+
+	for (i = 0; i < n && !j->stop; i++) {
+		rec = records + (size_t) i * reclen;
+		if ((j->probe->scan_options & DBF_SKIP_DELETED) && rec[0] == '*')
+			continue;
+		len = j->probelen;
+		key = dbf_JoinKey(rec + j->probeoff, &len, j->probetrim);
+		if (len == 0 || dbf_IsNull(j->probe, rec, j->probecol) > 0)
+			continue;
+		hash = dbf_JoinHash(key, len);
+
+		for (r = j->heads[hash & j->mask]; r != DBF_JOIN_END; r = j->next[r]) {
+			const char *brec = j->records + (size_t) r * buildlen;
+
+			if (j->hashes[r] != hash)
+				continue;
+			blen = j->buildlen;
+			bkey = dbf_JoinKey(brec + j->buildoff, &blen, j->buildtrim);
+			if (blen != len || memcmp(bkey, key, len) != 0)
+				continue;
+			j->count[worker]++;
+			if (j->callback(j->ctx, r, brec, first + i, rec, worker)) {
+				j->stop = 1;
+				break;
+			}
+		}
+	}
+}
+/* }}} */
+
+/* dbf_HashJoin() {{{
+ * Passes all pairs of records with equal keys to the callback
+ */
+long dbf_HashJoin(P_DBF *build, int buildcol, P_DBF *probe, int probecol, DBF_JOIN callback, void *ctx, int threads)
+{
+	struct dbf_Join j;
+	u_int32_t reclen = build->header->record_length;
+	u_int32_t nrecs = build->header->records;
+	u_int32_t nchunks, size, r, hash;
+	char *buf = NULL;
+	const char *rec, *key;
+	long total = 0;
+	int i, n, len, ret = -1;
+
+	if (buildcol < 0 || buildcol >= (int) build->columns || NULL == build->plan || reclen == 0)
+		return -1;
+	if (probecol < 0 || probecol >= (int) probe->columns || NULL == probe->plan || probe->header->record_length == 0)
+		return -1;
+
+	memset(&j, 0, sizeof(j));
+	j.build = build;
+	j.probe = probe;
+	j.buildcol = buildcol;
+	j.buildoff = build->plan->offset[buildcol];
+	j.buildlen = build->plan->length[buildcol];
+	j.buildtrim = dbf_JoinTrim(&build->fields[buildcol]);
+	j.probecol = probecol;
+	j.probeoff = probe->plan->offset[probecol];
+	j.probelen = probe->plan->length[probecol];
+	j.probetrim = dbf_JoinTrim(&probe->fields[probecol]);
+	j.callback = callback;
+	j.ctx = ctx;
+
+	/* The records of the build table are read in one go */
+	if (NULL == build->mem && NULL == (buf = malloc((size_t) nrecs * reclen + 1)))
+		return -1;
+	if (0 > (n = dbf_ReadBlock(build, 0, nrecs, buf, &j.records)))
+		goto cleanup;
+	nrecs = n;
+
+	for (size = 64; size < 2 * nrecs; size *= 2)
+		;
+	j.mask = size - 1;
+	j.heads = malloc(size * sizeof(u_int32_t));
+	j.next = malloc((nrecs + 1) * sizeof(u_int32_t));
+	j.hashes = malloc((nrecs + 1) * sizeof(u_int32_t));
+	if (!j.heads || !j.next || !j.hashes)
+		goto cleanup;
+	memset(j.heads, 0xFF, size * sizeof(u_int32_t));
+
+	/* Chains are built backwards, so they list the records in order */
+	for (r = nrecs; r-- > 0; ) {
+		rec = j.records + (size_t) r * reclen;
+		if ((build->scan_options & DBF_SKIP_DELETED) && rec[0] == '*')
+			continue;
+		len = j.buildlen;
+		key = dbf_JoinKey(rec + j.buildoff, &len, j.buildtrim);
+		if (len == 0 || dbf_IsNull(build, rec, buildcol) > 0)
+			continue;
+		hash = dbf_JoinHash(key, len);
+		j.hashes[r] = hash;
+		j.next[r] = j.heads[hash & j.mask];
+		j.heads[hash & j.mask] = r;
+	}
+
+	j.chunkrecs = DBF_BLOCK_SIZE / probe->header->record_length;
+	if (j.chunkrecs == 0)
+		j.chunkrecs = 1;
+	nchunks = (probe->header->records + j.chunkrecs - 1) / j.chunkrecs;
+	threads = dbf_TableThreads(probe, threads);
+
+	j.raw = calloc(threads, sizeof(char *));
+	j.count = calloc(threads, sizeof(long));
+	if (!j.raw || !j.count)
+		goto cleanup;
+	for (i = 0; i < threads; i++) {
+		if (NULL == probe->mem && NULL == (j.raw[i] = malloc((size_t) j.chunkrecs * probe->header->record_length)))
+			goto cleanup;
+	}
+
+	dbf_RunTasks(threads, nchunks, dbf_JoinChunk, &j);
+	if (j.failed)
+		goto cleanup;
+	for (i = 0; i < threads; i++)
+		total += j.count[i];
+	ret = 0;
+
+cleanup:
+	for (i = 0; j.raw && i < threads; i++) {
+		if (j.raw[i])
+			free(j.raw[i]);
+	}
+	if (j.raw)
+		free(j.raw);
+	if (j.count)
+		free(j.count);
+	if (j.heads)
+		free(j.heads);
+	if (j.next)
+		free(j.next);
+	if (j.hashes)
+		free(j.hashes);
+	if (buf)
+		free(buf);
+
+	return ret < 0 ? -1 : total;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,196 @@
+/*****************************************************************************
+ * lock.c
+ *****************************************************************************
+ * Shares dBASE files between processes appending and reading records
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/*
+ * The locks follow the convention of Visual FoxPro: the header is locked
+ * at byte 0x7FFFFFFE and record n (counted from 1) at 0x7FFFFFFE - n,
+ * far behind the end of the file, so locks never block reading or
+ * writing the data. An appender writes the record first and then
+ * increases the number of records in the header, both while holding
+ * the header lock. Readers only take the header lock to read the number
+ * of records and never see records which are not completely written.
+ */
+
+#define DBF_LOCK_HEADER 0x7FFFFFFEL
+
+/* dbf_Lock() {{{
+ * Locks one byte at offset, F_RDLCK and F_WRLCK wait for the lock and
+ * F_UNLCK releases it. Does nothing unless the file was opened with
+ * DBF_OPEN_SHARED.
+ */
+int dbf_Lock(P_DBF *p_dbf, off_t offset, int type)
+{
+#ifdef F_SETLKW
+	struct flock fl;
+
+	if (p_dbf->mem || !(p_dbf->open_flags & DBF_OPEN_SHARED))
+		return 0;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = type;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = offset;
+	fl.l_len = 1;
+	while (fcntl(p_dbf->dbf_fh, F_SETLKW, &fl) == -1) {
+		if (errno != EINTR)
+			return -1;
+	}
+#endif
+
+	return 0;
+}
+/* }}} */
+
+/* static dbf_ReadCount() {{{
+ * Reads the number of records from the header in the file
+ */
+static int dbf_ReadCount(P_DBF *p_dbf, u_int32_t *records)
+{
+	unsigned char buf[4];
+
+	if (dbf_ReadAt(p_dbf, buf, 4, 4) != 4)
+		return -1;
+	*records = dbf_Load32(buf);
+
+	return 0;
+}
+/* }}} */
+
+/* dbf_AppendLocked() {{{
+ * Appends a record to a shared file. The record and the end of file
+ * marker are written in one go behind the last record in the file,
+ * which may have been written by another process, before the header
+ * counts it.
+ */
+int dbf_AppendLocked(P_DBF *p_dbf, const char *record, int len)
+{
+	u_int32_t reclen = p_dbf->header->record_length;
+	u_int32_t records;
+	char *buf;
+	int ret = -1;
+
+	if (NULL == (buf = malloc(reclen + 1)))
+		return -1;
+	buf[0] = ' ';
+	memcpy(buf + 1, record, len);
+	buf[reclen] = 0x1A;
+
+	if (0 > dbf_Lock(p_dbf, DBF_LOCK_HEADER, F_WRLCK)) {
+		free(buf);
+		return -1;
+	}
+	if (0 > dbf_ReadCount(p_dbf, &records))
+		goto unlock;
+	if (dbf_WriteAt(p_dbf, buf, reclen + 1,
+			p_dbf->header->header_length + (off_t) records * reclen) == -1)
+		goto unlock;
+	p_dbf->header->records = records + 1;
+	if (0 > dbf_WriteHeaderInfo(p_dbf, p_dbf->header))
+		goto unlock;
+	ret = p_dbf->header->records;
+
+unlock:
+	dbf_Lock(p_dbf, DBF_LOCK_HEADER, F_UNLCK);
+	free(buf);
+
+	return ret;
+}
+/* }}} */
+
+/* dbf_WriteHeaderShared() {{{
+ * Writes the header like dbf_WriteHeaderInfo(). In a shared file the
+ * number of records is read again while holding the header lock, so
+ * records appended by other processes are not dropped from the count.
+ */
+int dbf_WriteHeaderShared(P_DBF *p_dbf)
+{
+	u_int32_t records;
+	int ret = -1;
+
+	if (p_dbf->mem || !(p_dbf->open_flags & DBF_OPEN_SHARED))
+		return dbf_WriteHeaderInfo(p_dbf, p_dbf->header);
+
+	if (0 > dbf_Lock(p_dbf, DBF_LOCK_HEADER, F_WRLCK))
+		return -1;
+	if (0 > dbf_ReadCount(p_dbf, &records))
+		goto unlock;
+	if (records > p_dbf->header->records)
+		p_dbf->header->records = records;
+	ret = dbf_WriteHeaderInfo(p_dbf, p_dbf->header);
+
+unlock:
+	dbf_Lock(p_dbf, DBF_LOCK_HEADER, F_UNLCK);
+
+	return ret;
+}
+/* }}} */
+
+/* dbf_Refresh() {{{
+ * Updates the number of records from the file
+ */
+int dbf_Refresh(P_DBF *p_dbf)
+{
+	u_int32_t records;
+	int ret;
+
+	if (p_dbf->mem)
+		return p_dbf->header->records;
+
+	if (0 > dbf_Lock(p_dbf, DBF_LOCK_HEADER, F_RDLCK))
+		return -1;
+	ret = dbf_ReadCount(p_dbf, &records);
+	dbf_Lock(p_dbf, DBF_LOCK_HEADER, F_UNLCK);
+	if (ret < 0)
+		return -1;
+	p_dbf->header->records = records;
+
+	return records;
+}
+/* }}} */
+
+/* dbf_LockRecord() {{{
+ */
+int dbf_LockRecord(P_DBF *p_dbf, int recno, int exclusive)
+{
+	if (recno < 0)
+		return -1;
+
+	return dbf_Lock(p_dbf, DBF_LOCK_HEADER - 1 - recno, exclusive ? F_WRLCK : F_RDLCK);
+}
+/* }}} */
+
+/* dbf_UnlockRecord() {{{
+ */
+int dbf_UnlockRecord(P_DBF *p_dbf, int recno)
+{
+	if (recno < 0)
+		return -1;
+
+	return dbf_Lock(p_dbf, DBF_LOCK_HEADER - 1 - recno, F_UNLCK);
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,253 @@
+/*****************************************************************************
+ * pack.c
+ *****************************************************************************
+ * Removes deleted records from dBASE files
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/* static dbf_PackRecords() {{{
+ * Copies all records which are not deleted from p_dbf into the table
+ * out, starting at offset. Records are read and written
+ * in blocks of DBF_BLOCK_SIZE. Because live records are never moved
+ * towards the end of the table, out may be the table itself.
+ * Returns the number of records copied or -1 on error.
+ */
+static long dbf_PackRecords(P_DBF *p_dbf, P_DBF *out, off_t offset)
+{
+	u_int32_t reclen = p_dbf->header->record_length;
+	u_int32_t nrecs = p_dbf->header->records;
+	u_int32_t blockrecs, recno;
+	const char *records;
+	char *buf = NULL, *outbuf;
+	size_t outlen = 0;
+	long live = 0;
+	int n = 0, i;
+
+	blockrecs = DBF_BLOCK_SIZE / reclen;
+	if (blockrecs == 0)
+		blockrecs = 1;
+	if (NULL == (outbuf = malloc(blockrecs * reclen)))
+		return -1;
+	if (NULL == p_dbf->mem && NULL == (buf = malloc(blockrecs * reclen))) {
+		free(outbuf);
+		return -1;
+	}
+
+	for (recno = 0; recno < nrecs; recno += n) {
+		if (0 >= (n = dbf_ReadBlock(p_dbf, recno, blockrecs, buf, &records)))
+			break;
+		for (i = 0; i < n; i++) {
+			if (records[i * reclen] == '*')
+				continue;
+			if (outlen + reclen > blockrecs * reclen) {
+				if (dbf_WriteAt(out, outbuf, outlen, offset) == -1)
+					goto error;
+				offset += outlen;
+				outlen = 0;
+			}
+			memcpy(outbuf + outlen, records + i * reclen, reclen);
+			outlen += reclen;
+			live++;
+		}
+	}
+	if (n < 0)
+		goto error;
+	if (outlen > 0 && dbf_WriteAt(out, outbuf, outlen, offset) == -1)
+		goto error;
+
+	free(outbuf);
+	if (buf)
+		free(buf);
+	return live;
+
+error:
+	free(outbuf);
+	if (buf)
+		free(buf);
+	return -1;
+}
+/* }}} */
+
+/* static dbf_PackInPlace() {{{
+ * Compacts the records within the table itself. The transaction flag
+ * of the header is set while records are moved, so that an interrupted
+ * pack can be detected.
+ */
+static int dbf_PackInPlace(P_DBF *p_dbf, off_t *newsize)
+{
+	long live;
+	off_t end;
+
+	p_dbf->header->transaction = 1;
+	if (0 > dbf_WriteHeaderInfo(p_dbf, p_dbf->header))
+		return -1;
+	if (p_dbf->dbf_fh != -1)
+		fsync(p_dbf->dbf_fh);
+
+	if (0 > (live = dbf_PackRecords(p_dbf, p_dbf, p_dbf->header->header_length)))
+		return -1;
+
+	end = p_dbf->header->header_length + (off_t) live * p_dbf->header->record_length;
+	if (p_dbf->mem_alloc) {
+		/* Memory buffers are still appended to, so there is no end marker */
+		p_dbf->mem_len = end;
+	} else {
+		if (dbf_WriteAt(p_dbf, "\x1a", 1, end) == -1)
+			return -1;
+		end++;
+		if (ftruncate(p_dbf->dbf_fh, end) == -1)
+			return -1;
+	}
+
+	p_dbf->header->records = live;
+	p_dbf->header->transaction = 0;
+	if (0 > dbf_WriteHeaderInfo(p_dbf, p_dbf->header))
+		return -1;
+	if (p_dbf->dbf_fh != -1)
+		fsync(p_dbf->dbf_fh);
+
+	*newsize = end;
+	return 0;
+}
+/* }}} */
+
+/* static dbf_PackTempFile() {{{
+ * Writes the live records into a temporary file next to the table,
+ * which replaces the table once it has been completely written.
+ */
+static int dbf_PackTempFile(P_DBF *p_dbf, off_t *newsize)
+{
+	P_DBF tmp;
+	struct stat st;
+	char *tmpname, *head;
+	long live;
+	off_t end;
+	int fh;
+
+	if (NULL == p_dbf->filename)
+		return -1;
+	if (fstat(p_dbf->dbf_fh, &st) == -1)
+		return -1;
+
+	if (NULL == (tmpname = malloc(strlen(p_dbf->filename) + 8)))
+		return -1;
+	sprintf(tmpname, "%s.XXXXXX", p_dbf->filename);
+	if ((fh = mkstemp(tmpname)) == -1) {
+		free(tmpname);
+		return -1;
+	}
+	fchmod(fh, st.st_mode & 07777);
+
+	/* The temporary table is only written through dbf_WriteAt() */
+	memset(&tmp, 0, sizeof(P_DBF));
+	tmp.dbf_fh = fh;
+
+	/* Copy header and field descriptors unchanged */
+	if (NULL == (head = malloc(p_dbf->header->header_length)))
+		goto error;
+	if (dbf_ReadAt(p_dbf, head, p_dbf->header->header_length, 0) != p_dbf->header->header_length ||
+		dbf_WriteAt(&tmp, head, p_dbf->header->header_length, 0) == -1) {
+		free(head);
+		goto error;
+	}
+	free(head);
+
+	if (0 > (live = dbf_PackRecords(p_dbf, &tmp, p_dbf->header->header_length)))
+		goto error;
+
+	end = p_dbf->header->header_length + (off_t) live * p_dbf->header->record_length;
+	if (dbf_WriteAt(&tmp, "\x1a", 1, end) == -1)
+		goto error;
+
+	p_dbf->header->records = live;
+	if (0 > dbf_WriteHeaderInfo(&tmp, p_dbf->header))
+		goto error;
+	if (fsync(fh) == -1)
+		goto error;
+
+	if (rename(tmpname, p_dbf->filename) == -1)
+		goto error;
+
+	close(p_dbf->dbf_fh);
+	p_dbf->dbf_fh = fh;
+	free(tmpname);
+
+	*newsize = end + 1;
+	return 0;
+
+error:
+	close(fh);
+	unlink(tmpname);
+	free(tmpname);
+	return -1;
+}
+/* }}} */
+
+/* dbf_Pack() {{{
+ * Removes all deleted records from the table
+ */
+int dbf_Pack(P_DBF *p_dbf, int mode, int64_t *reclaimed)
+{
+	struct stat st;
+	off_t oldsize, newsize;
+	u_int32_t records;
+	int ret;
+
+	if (p_dbf->mem && NULL == p_dbf->mem_alloc)
+		return -1;
+	if (NULL == p_dbf->mem && !(p_dbf->open_flags & DBF_OPEN_RDWR))
+		return -1;
+	if (p_dbf->header->record_length == 0)
+		return -1;
+
+	/* Records are moved behind the back of the cache */
+	if (0 > dbf_Flush(p_dbf))
+		return -1;
+	dbf_CacheFree(p_dbf);
+
+	if (p_dbf->mem_alloc) {
+		oldsize = p_dbf->mem_len;
+	} else {
+		if (fstat(p_dbf->dbf_fh, &st) == -1)
+			return -1;
+		oldsize = st.st_size;
+	}
+
+	records = p_dbf->header->records;
+	if (mode == DBF_PACK_TEMPFILE && NULL == p_dbf->mem_alloc)
+		ret = dbf_PackTempFile(p_dbf, &newsize);
+	else
+		ret = dbf_PackInPlace(p_dbf, &newsize);
+	if (ret < 0) {
+		p_dbf->header->records = records;
+		return -1;
+	}
+
+	p_dbf->cur_record = 0;
+	if (reclaimed)
+		*reclaimed = oldsize > newsize ? oldsize - newsize : 0;
+
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
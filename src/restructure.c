@@ -0,0 +1,286 @@
+/*****************************************************************************
+ * restructure.c
+ *****************************************************************************
+ * Copies dBASE files into files with different fields
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/*
+ * The mapping of the columns is compiled into a list of operations,
+ * each one either copying a range of bytes from the old record into the
+ * new one or filling a range of the new record. Adjacent ranges are
+ * merged, so columns which keep their order and width are copied by one
+ * memcpy() per record.
+ */
+
+struct dbf_RestructOp {
+	/* position in the old record, -1 to fill */
+	int from;
+	/* position in the new record */
+	u_int32_t to;
+	u_int32_t len;
+	char fill;
+};
+
+/* static dbf_RestructAdd() {{{
+ * Appends an operation, merging it with the previous one if possible
+ */
+static void dbf_RestructAdd(struct dbf_RestructOp *ops, int *nops, int from, u_int32_t to, u_int32_t len, char fill)
+{
+	struct dbf_RestructOp *last = *nops > 0 ? &ops[*nops - 1] : NULL;
+
+	if (len == 0)
+		return;
+	if (last && last->to + last->len == to &&
+		((from < 0 && last->from < 0 && last->fill == fill) ||
+		 (from >= 0 && last->from >= 0 && last->from + (int) last->len == from))) {
+		last->len += len;
+		return;
+	}
+	ops[*nops].from = from;
+	ops[*nops].to = to;
+	ops[*nops].len = len;
+	ops[*nops].fill = fill;
+	(*nops)++;
+}
+/* }}} */
+
+/* static dbf_RestructCompile() {{{
+ * Turns the mapping into operations. Returns the number of operations or
+ * -1 if a column cannot be copied without converting its values. Memo
+ * fields are refused since no memo file is written, binary fields since
+ * Visual FoxPro versions are not written and nullable columns since their
+ * _NullFlags are not copied.
+ */
+static int dbf_RestructCompile(P_DBF *p_dbf, DB_FIELD *fields, const int *map, int numfields,
+	struct dbf_RestructOp *ops)
+{
+	DB_FIELD *src, *dst;
+	u_int32_t to = 1;
+	int i, from, nops = 0;
+	char fill = ' ';
+
+	/* The deletion flag */
+	dbf_RestructAdd(ops, &nops, 0, 0, 1, ' ');
+
+	for (i = 0; i < numfields; i++) {
+		dst = &fields[i];
+		switch (dst->field_type) {
+			case 'M':
+			case 'G':
+			case 'P':
+			case 'I':
+			case 'B':
+			case 'Y':
+			case 'T':
+			case '0':
+				return -1;
+		}
+
+		if (map[i] < 0) {
+			dbf_RestructAdd(ops, &nops, -1, to, dst->field_length, fill);
+			to += dst->field_length;
+			continue;
+		}
+		if (map[i] >= (int) p_dbf->columns)
+			return -1;
+		src = &p_dbf->fields[map[i]];
+		from = src->field_offset;
+		if (src->field_type != dst->field_type)
+			return -1;
+		if (p_dbf->null_bits && p_dbf->null_bits[map[i]] >= 0)
+			return -1;
+
+		switch (dst->field_type) {
+			case 'C':
+				/* Text is aligned left, so it is cut or padded on the right */
+				if (dst->field_length <= src->field_length) {
+					dbf_RestructAdd(ops, &nops, from, to, dst->field_length, fill);
+				} else {
+					dbf_RestructAdd(ops, &nops, from, to, src->field_length, fill);
+					dbf_RestructAdd(ops, &nops, -1, to + src->field_length,
+						dst->field_length - src->field_length, fill);
+				}
+				break;
+			case 'N':
+			case 'F':
+				/* Numbers are aligned right and can only become wider */
+				if (dst->field_length < src->field_length || dst->field_decimals != src->field_decimals)
+					return -1;
+				dbf_RestructAdd(ops, &nops, -1, to, dst->field_length - src->field_length, fill);
+				dbf_RestructAdd(ops, &nops, from, to + dst->field_length - src->field_length,
+					src->field_length, fill);
+				break;
+			default:
+				if (dst->field_length != src->field_length)
+					return -1;
+				dbf_RestructAdd(ops, &nops, from, to, dst->field_length, fill);
+				break;
+		}
+		to += dst->field_length;
+	}
+
+	return nops;
+}
+/* }}} */
+
+/* dbf_Restructure() {{{
+ * Copies the records into a new file with the given fields
+ */
+long dbf_Restructure(P_DBF *p_dbf, const char *file, DB_FIELD *fields, const int *map, int numfields, int version)
+{
+	u_int32_t reclen = p_dbf->header->record_length;
+	u_int32_t nrecs = p_dbf->header->records;
+	u_int32_t newlen = 1, blockrecs, outrecs, recno, headlen;
+	struct dbf_RestructOp *ops;
+	DB_HEADER header;
+	DB_FIELD *head = NULL;
+	P_DBF out;
+	const char *records, *rec;
+	char *buf = NULL, *outbuf = NULL, *dst;
+	size_t outlen = 0;
+	off_t offset;
+	long count = 0;
+	int i, k, n = 0, nops, fh = -1;
+	long ret = -1;
+
+	if (numfields <= 0 || reclen == 0)
+		return -1;
+	if (version == 0) {
+		/* Keep the version, without the memo file */
+		switch (version = p_dbf->header->version) {
+			case dBase3WM:
+			case FoxPro2WM:
+				version = dBase3;
+				break;
+			case dBase4WM:
+				version = dBase4;
+				break;
+		}
+	}
+	/* Visual FoxPro tables need a backlink and _NullFlags, which are not written */
+	if (version == VisualFoxPro || version == VisualFoxProAI || version == VisualFoxProVar)
+		return -1;
+	/* Nor is a memo file, so the version must not announce one */
+	if (version == dBase3WM || version == dBase4WM || version == FoxPro2WM)
+		return -1;
+	for (i = 0; i < numfields; i++)
+		newlen += fields[i].field_length;
+	if (newlen > 0xFFFF)
+		return -1;
+
+	if (NULL == (ops = malloc((2 * numfields + 1) * sizeof(struct dbf_RestructOp))))
+		return -1;
+	if (0 > (nops = dbf_RestructCompile(p_dbf, fields, map, numfields, ops)))
+		goto cleanup;
+
+	blockrecs = DBF_BLOCK_SIZE / reclen;
+	if (blockrecs == 0)
+		blockrecs = 1;
+	outrecs = DBF_BLOCK_SIZE / newlen;
+	if (outrecs == 0)
+		outrecs = 1;
+	if (NULL == (outbuf = malloc((size_t) outrecs * newlen)))
+		goto cleanup;
+	if (NULL == p_dbf->mem && NULL == (buf = malloc((size_t) blockrecs * reclen)))
+		goto cleanup;
+
+	/* Header and field descriptors, the offsets are not stored */
+	headlen = sizeof(DB_HEADER) + numfields * sizeof(DB_FIELD) + 2;
+	if (NULL == (head = calloc(1, headlen - sizeof(DB_HEADER))))
+		goto cleanup;
+	memcpy(head, fields, numfields * sizeof(DB_FIELD));
+	for (i = 0; i < numfields; i++) {
+		head[i].field_address = 0;
+		head[i].field_offset = 0;
+	}
+	((char *) head)[numfields * sizeof(DB_FIELD)] = '\r';
+
+	if ((fh = open(file, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY, 0644)) == -1)
+		goto cleanup;
+	memset(&out, 0, sizeof(P_DBF));
+	out.dbf_fh = fh;
+	if (dbf_WriteAt(&out, head, headlen - sizeof(DB_HEADER), sizeof(DB_HEADER)) == -1)
+		goto cleanup;
+	offset = headlen;
+
+	for (recno = 0; recno < nrecs; recno += n) {
+		if (0 >= (n = dbf_ReadBlock(p_dbf, recno, blockrecs, buf, &records))) {
+			if (n < 0)
+				goto cleanup;
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			rec = records + (size_t) i * reclen;
+			if ((p_dbf->scan_options & DBF_SKIP_DELETED) && rec[0] == '*')
+				continue;
+			if (outlen + newlen > (size_t) outrecs * newlen) {
+				if (dbf_WriteAt(&out, outbuf, outlen, offset) == -1)
+					goto cleanup;
+				offset += outlen;
+				outlen = 0;
+			}
+			dst = outbuf + outlen;
+			for (k = 0; k < nops; k++) {
+				if (ops[k].from < 0)
+					memset(dst + ops[k].to, ops[k].fill, ops[k].len);
+				else
+					memcpy(dst + ops[k].to, rec + ops[k].from, ops[k].len);
+			}
+			outlen += newlen;
+			count++;
+		}
+	}
+	if (outlen > 0 && dbf_WriteAt(&out, outbuf, outlen, offset) == -1)
+		goto cleanup;
+	if (dbf_WriteAt(&out, "\x1a", 1, offset + outlen) == -1)
+		goto cleanup;
+
+	header = *p_dbf->header;
+	header.version = version;
+	header.records = count;
+	header.header_length = headlen;
+	header.record_length = newlen;
+	header.transaction = 0;
+	header.mdx = 0;
+	if (0 > dbf_WriteHeaderInfo(&out, &header))
+		goto cleanup;
+	ret = count;
+
+cleanup:
+	if (fh != -1 && close(fh) == -1)
+		ret = -1;
+	if (ret < 0 && fh != -1)
+		unlink(file);
+	free(ops);
+	if (head)
+		free(head);
+	if (outbuf)
+		free(outbuf);
+	if (buf)
+		free(buf);
+
+	return ret;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
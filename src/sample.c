@@ -0,0 +1,289 @@
+/*****************************************************************************
+ * sample.c
+ *****************************************************************************
+ * Estimates statistics of the columns of dBASE files from samples
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include <math.h>
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/*
+ * The sampled records are read one by one at their position in the file.
+ * Distinct values are counted by a HyperLogLog sketch of 2^DBF_HLL_BITS
+ * registers per column over the raw bytes of the fields. The sketch holds
+ * no frequencies, so the count is that of the sample and not extrapolated.
+ */
+
+#define DBF_HLL_BITS 12
+#define DBF_HLL_REGISTERS (1 << DBF_HLL_BITS)
+
+/* static dbf_SampleRandom() {{{
+ * xorshift64* generator
+ */
+static u_int64_t dbf_SampleRandom(u_int64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717ULL;
+}
+/* }}} */
+
+/* static dbf_SampleCompare() {{{
+ */
+static int dbf_SampleCompare(const void *a, const void *b)
+{
+	u_int32_t x = *(const u_int32_t *) a, y = *(const u_int32_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+/* }}} */
+
+/* static dbf_SampleHash() {{{
+ * 64 bit FNV-1a hash with a final mix of the bits
+ */
+static u_int64_t dbf_SampleHash(const char *data, int len)
+{
+	u_int64_t h = 14695981039346656037ULL;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char) data[i];
+		h *= 1099511628211ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return h;
+}
+/* }}} */
+
+/* static dbf_HLLAdd() {{{
+ */
+static void dbf_HLLAdd(unsigned char *registers, u_int64_t hash)
+{
+	u_int64_t rest = hash << DBF_HLL_BITS;
+	int index = hash >> (64 - DBF_HLL_BITS);
+	int rank = 1;
+
+	while (rank <= 64 - DBF_HLL_BITS && !(rest & (1ULL << 63))) {
+		rest <<= 1;
+		rank++;
+	}
+	if (rank > registers[index])
+		registers[index] = rank;
+}
+/* }}} */
+
+/* static dbf_HLLEstimate() {{{
+ * Raw HyperLogLog estimate with linear counting for small cardinalities
+ */
+static double dbf_HLLEstimate(const unsigned char *registers)
+{
+	double m = DBF_HLL_REGISTERS, sum = 0, estimate;
+	int i, zeros = 0;
+
+	for (i = 0; i < DBF_HLL_REGISTERS; i++) {
+		sum += 1.0 / ((u_int64_t) 1 << registers[i]);
+		zeros += (registers[i] == 0);
+	}
+	estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+	if (estimate <= 2.5 * m && zeros > 0)
+		estimate = m * log(m / zeros);
+
+	return estimate;
+}
+/* }}} */
+
+/* static dbf_SampleValue() {{{
+ * Decodes a field into a number. Returns 0 if it is a number, 1 if it is
+ * blank or null and -1 if it is no number.
+ */
+static int dbf_SampleValue(P_DBF *p_dbf, const char *rec, int column, double *v)
+{
+	const DBF_PLAN *plan = p_dbf->plan;
+	DBF_VALUE value;
+
+	value.type = plan->type[column];
+	plan->decode[column](rec + plan->offset[column], plan->length[column], &value);
+	if (p_dbf->null_bits && dbf_IsNull(p_dbf, rec, column) == 1)
+		return 1;
+
+	switch (value.type) {
+		case DBF_VALUE_NULL:
+			return 1;
+		case DBF_VALUE_STRING:
+			return value.v.str.len == 0 ? 1 : -1;
+		case DBF_VALUE_DOUBLE:
+			/* NaN and infinity parsed by strtod() or stored in B fields
+			 * have no place in the histogram
+			 */
+			if (!isfinite(value.v.d))
+				return -1;
+			*v = value.v.d;
+			return 0;
+		case DBF_VALUE_INT:
+		case DBF_VALUE_DATETIME:
+			*v = (double) value.v.i;
+			return 0;
+		case DBF_VALUE_CURRENCY:
+			*v = (double) value.v.i / 10000;
+			return 0;
+		case DBF_VALUE_DATE:
+			*v = value.v.days;
+			return 0;
+		case DBF_VALUE_BOOL:
+			*v = value.v.b;
+			return 0;
+	}
+
+	return -1;
+}
+/* }}} */
+
+/* dbf_Sample() {{{
+ * Estimates statistics of all columns from a sample of records
+ */
+int dbf_Sample(P_DBF *p_dbf, int nsamples, int flags, unsigned int seed, DBF_STATS *stats)
+{
+	u_int32_t nrecs = p_dbf->header->records;
+	u_int32_t reclen = p_dbf->header->record_length;
+	int ncols = p_dbf->columns;
+	unsigned char *registers = NULL;
+	double *values = NULL, v;
+	u_int32_t *positions = NULL;
+	u_int64_t state;
+	char *rec = NULL;
+	const char *data;
+	int i, c, n, len, ret = -1;
+
+	if (nsamples <= 0 || NULL == p_dbf->plan || reclen == 0)
+		return -1;
+	memset(stats, 0, ncols * sizeof(DBF_STATS));
+	if (nrecs == 0)
+		return 0;
+
+	/* Small tables are read completely */
+	if ((u_int32_t) nsamples > nrecs)
+		nsamples = nrecs;
+
+	positions = malloc(nsamples * sizeof(u_int32_t));
+	registers = calloc(ncols, DBF_HLL_REGISTERS);
+	values = malloc((size_t) nsamples * ncols * sizeof(double));
+	rec = malloc(reclen);
+	if (!positions || !registers || !values || !rec)
+		goto cleanup;
+
+	/* The positions are ascending, so the file is read in one direction */
+	state = ((u_int64_t) seed << 32) ^ 0x9E3779B97F4A7C15ULL;
+	for (i = 0; i < nsamples; i++) {
+		u_int32_t first = (u_int32_t) ((u_int64_t) nrecs * i / nsamples);
+		u_int32_t next = (u_int32_t) ((u_int64_t) nrecs * (i + 1) / nsamples);
+
+		if ((u_int32_t) nsamples == nrecs)
+			positions[i] = i;
+		else if (flags & DBF_SAMPLE_STRATIFIED)
+			positions[i] = first + dbf_SampleRandom(&state) % (next - first);
+		else
+			positions[i] = dbf_SampleRandom(&state) % nrecs;
+	}
+	if (!(flags & DBF_SAMPLE_STRATIFIED) && (u_int32_t) nsamples != nrecs) {
+		qsort(positions, nsamples, sizeof(u_int32_t), dbf_SampleCompare);
+	}
+
+	for (n = 0, i = 0; i < nsamples; i++) {
+		if (dbf_ReadAt(p_dbf, rec, reclen,
+				p_dbf->header->header_length + (off_t) positions[i] * reclen) != (ssize_t) reclen)
+			goto cleanup;
+		if ((p_dbf->scan_options & DBF_SKIP_DELETED) && rec[0] == '*')
+			continue;
+
+		for (c = 0; c < ncols; c++) {
+			DBF_STATS *s = &stats[c];
+
+			data = rec + p_dbf->plan->offset[c];
+			len = p_dbf->plan->length[c];
+			while (len > 0 && (data[len-1] == ' ' || data[len-1] == '\0'))
+				len--;
+			dbf_HLLAdd(registers + c * DBF_HLL_REGISTERS, dbf_SampleHash(data, len));
+
+			switch (dbf_SampleValue(p_dbf, rec, c, &v)) {
+				case 0:
+					if (s->numeric == 0 || v < s->min)
+						s->min = v;
+					if (s->numeric == 0 || v > s->max)
+						s->max = v;
+					values[(size_t) c * nsamples + s->numeric++] = v;
+					break;
+				case 1:
+					s->blanks++;
+					break;
+			}
+		}
+		n++;
+	}
+
+	for (c = 0; c < ncols; c++) {
+		DBF_STATS *s = &stats[c];
+
+		s->sampled = n;
+		s->distinct = n > 0 ? dbf_HLLEstimate(registers + c * DBF_HLL_REGISTERS) : 0;
+		if (s->distinct > n)
+			s->distinct = n;
+		/* Equal width bins between min and max, halved so that the
+		 * width cannot overflow
+		 */
+		for (i = 0; i < s->numeric; i++) {
+			double x = 0;
+			int bin;
+
+			v = values[(size_t) c * nsamples + i];
+			if (s->max > s->min)
+				x = (v / 2 - s->min / 2) / (s->max / 2 - s->min / 2) * DBF_STATS_BINS;
+			if (x >= DBF_STATS_BINS)
+				bin = DBF_STATS_BINS - 1;
+			else if (x > 0)
+				bin = (int) x;
+			else
+				bin = 0;
+			s->histogram[bin]++;
+		}
+	}
+	ret = n;
+
+cleanup:
+	if (positions)
+		free(positions);
+	if (registers)
+		free(registers);
+	if (values)
+		free(values);
+	if (rec)
+		free(rec);
+
+	return ret;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
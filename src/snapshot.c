@@ -0,0 +1,212 @@
+/*****************************************************************************
+ * snapshot.c
+ *****************************************************************************
+ * Copies dBASE files and their memo files, sharing blocks where possible
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+/* copy_file_range() is declared for GNU programs only */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+#if defined(HAVE_LINUX_FS_H) && defined(HAVE_SYS_IOCTL_H)
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+/*
+ * A snapshot is tried in three ways: the FICLONE ioctl shares all blocks
+ * of the file on filesystems like btrfs and XFS, copy_file_range() copies
+ * within the kernel and may share blocks as well, and plain reads and
+ * writes work everywhere.
+ */
+
+/* static dbf_CopyFile() {{{
+ * Copies size bytes from the start of in into out
+ */
+static int dbf_CopyFile(int in, int out, off_t size)
+{
+	char *buf;
+	off_t pos = 0;
+	ssize_t n = 0;
+
+#ifdef FICLONE
+	if (ioctl(out, FICLONE, in) == 0)
+		return 0;
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+	{
+		loff_t off_in = 0, off_out = 0;
+
+		while (pos < size) {
+			n = copy_file_range(in, &off_in, out, &off_out, size - pos, 0);
+			if (n <= 0)
+				break;
+			pos += n;
+		}
+		if (pos == size)
+			return 0;
+		/* Not supported between these files, copy the rest by hand */
+		if (n < 0 && errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+			errno != EOPNOTSUPP && errno != EBADF)
+			return -1;
+	}
+#endif
+
+	if (NULL == (buf = malloc(DBF_BLOCK_SIZE)))
+		return -1;
+	while (pos < size) {
+		n = size - pos < DBF_BLOCK_SIZE ? size - pos : DBF_BLOCK_SIZE;
+#ifdef HAVE_PREAD
+		n = pread(in, buf, n, pos);
+#else
+		if (lseek(in, pos, SEEK_SET) == -1) {
+			free(buf);
+			return -1;
+		}
+		n = read(in, buf, n);
+#endif
+		if (n <= 0) {
+			free(buf);
+			return -1;
+		}
+		if (lseek(out, pos, SEEK_SET) == -1 || dbf_WriteAll(out, buf, n) < 0) {
+			free(buf);
+			return -1;
+		}
+		pos += n;
+	}
+	free(buf);
+
+	return 0;
+}
+/* }}} */
+
+/* static dbf_CopyTo() {{{
+ * Copies the open file in into a new file of the given name
+ */
+static int dbf_CopyTo(int in, const char *file)
+{
+	struct stat st;
+	int out, ret;
+
+	if (fstat(in, &st) == -1 || !S_ISREG(st.st_mode))
+		return -1;
+	if ((out = open(file, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY, st.st_mode & 0777)) == -1)
+		return -1;
+
+	ret = dbf_CopyFile(in, out, st.st_size);
+	if (close(out) == -1)
+		ret = -1;
+	if (ret < 0)
+		unlink(file);
+
+	return ret;
+}
+/* }}} */
+
+/* static dbf_MemoName() {{{
+ * Returns the name of the file with the extension ext instead of its own
+ */
+static char *dbf_MemoName(const char *file, const char *ext)
+{
+	const char *dot = strrchr(file, '.');
+	const char *slash = strrchr(file, '/');
+	size_t len;
+	char *name;
+
+	if (NULL == dot || (slash && dot < slash))
+		len = strlen(file);
+	else
+		len = dot - file;
+	if (NULL == (name = malloc(len + strlen(ext) + 1)))
+		return NULL;
+	memcpy(name, file, len);
+	strcpy(name + len, ext);
+
+	return name;
+}
+/* }}} */
+
+/* dbf_Snapshot() {{{
+ * Copies the table and its memo file into new files
+ */
+int dbf_Snapshot(P_DBF *p_dbf, const char *file)
+{
+	static const char *exts[] = { ".fpt", ".FPT", ".dbt", ".DBT" };
+	char *src, *dst;
+	int i, fh, out, ret;
+
+	/* Tables in memory are simply written out. The header of tables
+	 * created by dbf_CreateMemory() is only written when they are
+	 * closed, so it is brought up to date first.
+	 */
+	if (p_dbf->mem) {
+		if (p_dbf->mem_alloc && 0 > dbf_WriteHeaderInfo(p_dbf, p_dbf->header))
+			return -1;
+		if ((out = open(file, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY, 0644)) == -1)
+			return -1;
+		ret = dbf_WriteAll(out, (const char *) p_dbf->mem, p_dbf->mem_len);
+		if (ret == 0 && p_dbf->mem_alloc)
+			ret = dbf_WriteAll(out, "\x1a", 1);
+		if (close(out) == -1)
+			ret = -1;
+		if (ret < 0)
+			unlink(file);
+		return ret < 0 ? -1 : 0;
+	}
+
+	/* The snapshot includes the updates held in the cache */
+	if (0 > dbf_Flush(p_dbf))
+		return -1;
+	if (0 > dbf_CopyTo(p_dbf->dbf_fh, file))
+		return -1;
+	if (NULL == p_dbf->filename || dbf_IsMemo(p_dbf) != 1)
+		return 0;
+
+	for (i = 0; i < (int) (sizeof(exts) / sizeof(exts[0])); i++) {
+		if (NULL == (src = dbf_MemoName(p_dbf->filename, exts[i])))
+			return -1;
+		fh = open(src, O_RDONLY|O_BINARY);
+		free(src);
+		if (fh == -1)
+			continue;
+		if (NULL == (dst = dbf_MemoName(file, exts[i]))) {
+			close(fh);
+			return -1;
+		}
+		ret = dbf_CopyTo(fh, dst);
+		close(fh);
+		free(dst);
+		/* A table without its memo file is no snapshot */
+		if (ret < 0)
+			unlink(file);
+		return ret;
+	}
+
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,540 @@
+/*****************************************************************************
+ * sort.c
+ *****************************************************************************
+ * Sorts dBASE files larger than memory by one column
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include <math.h>
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/*
+ * The table is read in runs which fill the memory given. The keys of a
+ * run are split into one slice per thread, the slices are sorted in
+ * parallel and merged into a temporary file. The runs are finally merged
+ * into the new table. If the table fits into one run, the slices are
+ * merged into the new table right away. Equal keys keep the order of the
+ * records in the table.
+ */
+
+/* default memory for the records of one run */
+#define DBF_SORT_MEMORY (64 * 1024 * 1024)
+
+struct dbf_SortSpec {
+	/* offset and length of the key within the record */
+	u_int32_t offset;
+	int length;
+	/* decoder of the column, NULL to compare the raw bytes */
+	DBF_DECODER decode;
+	int type;
+	int desc;
+};
+
+struct dbf_SortKey {
+	const struct dbf_SortSpec *spec;
+	const char *rec;
+	/* decoded key, -HUGE_VAL for blank and null fields and NaN */
+	double num;
+	/* exact key of integers, currencies and datetimes, which a double
+	 * cannot hold beyond 2^53, compared when num is equal
+	 */
+	int64_t inum;
+};
+
+/* Sorted keys from memory or records from a run file */
+struct dbf_SortSource {
+	struct dbf_SortKey cur;
+	/* slice of keys */
+	struct dbf_SortKey *keys;
+	size_t pos, end;
+	/* run file, read through buf */
+	FILE *fp;
+	P_DBF run;
+	char *buf;
+	u_int32_t bufrecs, n, i, left;
+	off_t offset;
+	int index;
+};
+
+struct dbf_SortWriter {
+	P_DBF *out;
+	char *buf;
+	size_t len, size;
+	off_t offset;
+	long count;
+};
+
+struct dbf_SortCtx {
+	const struct dbf_SortSpec *spec;
+	struct dbf_SortKey *keys;
+	size_t nkeys;
+	int nslices;
+};
+
+/* static dbf_SortDecodeNumber() {{{
+ * Decodes the numeric fields without decimals that are too long for the
+ * plan to decode as integers, exactly as long as they fit into 18 digits
+ */
+static void dbf_SortDecodeNumber(const char *data, int len, DBF_VALUE *value)
+{
+	int scale, ret;
+
+	if (0 == (ret = dbf_ParseNumber(data, len, &value->v.i, &scale)) && scale == 0) {
+		value->type = DBF_VALUE_INT;
+	} else if (ret <= 0 && 0 == dbf_ParseDouble(data, len, &value->v.d)) {
+		value->type = DBF_VALUE_DOUBLE;
+	} else {
+		value->type = DBF_VALUE_NULL;
+	}
+}
+/* }}} */
+
+/* static dbf_SortMakeKey() {{{
+ */
+static void dbf_SortMakeKey(const struct dbf_SortSpec *spec, const char *rec, struct dbf_SortKey *key)
+{
+	DBF_VALUE value;
+
+	key->spec = spec;
+	key->rec = rec;
+	key->num = 0;
+	key->inum = 0;
+	if (NULL == spec->decode)
+		return;
+
+	value.type = spec->type;
+	spec->decode(rec + spec->offset, spec->length, &value);
+	switch (value.type) {
+		case DBF_VALUE_DOUBLE:
+			/* NaN compares equal to everything, it is sorted with the
+			 * blank fields so that the order stays consistent
+			 */
+			if (isnan(value.v.d)) {
+				key->num = -HUGE_VAL;
+				key->inum = -DBF_INT64_MAX - 1;
+				break;
+			}
+			key->num = value.v.d;
+			/* rounds like the integers, which are ordered by num first */
+			if (value.v.d >= 9223372036854775807.0)
+				key->inum = DBF_INT64_MAX;
+			else if (value.v.d <= -9223372036854775807.0)
+				key->inum = -DBF_INT64_MAX;
+			else
+				key->inum = (int64_t) value.v.d;
+			break;
+		case DBF_VALUE_INT:
+		case DBF_VALUE_DATETIME:
+		case DBF_VALUE_CURRENCY:
+			key->num = (double) value.v.i;
+			key->inum = value.v.i;
+			break;
+		case DBF_VALUE_DATE:
+			key->num = value.v.days;
+			break;
+		case DBF_VALUE_BOOL:
+			key->num = value.v.b;
+			break;
+		default:
+			/* before -infinity */
+			key->num = -HUGE_VAL;
+			key->inum = -DBF_INT64_MAX - 1;
+			break;
+	}
+}
+/* }}} */
+
+/* static dbf_SortCompareKeys() {{{
+ * Compares two keys without regard to the position of the records
+ */
+static int dbf_SortCompareKeys(const struct dbf_SortSpec *spec, const struct dbf_SortKey *a, const struct dbf_SortKey *b)
+{
+	int ret;
+
+	if (spec->decode) {
+		ret = a->num < b->num ? -1 : a->num > b->num;
+		if (0 == ret)
+			ret = a->inum < b->inum ? -1 : a->inum > b->inum;
+	} else
+		ret = memcmp(a->rec + spec->offset, b->rec + spec->offset, spec->length);
+
+	return spec->desc ? -ret : ret;
+}
+/* }}} */
+
+/* static dbf_SortCompare() {{{
+ * Compares two keys of one slice, equal keys by the position of the records
+ */
+static int dbf_SortCompare(const void *a, const void *b)
+{
+	const struct dbf_SortKey *x = a, *y = b;
+	int ret = dbf_SortCompareKeys(x->spec, x, y);
+
+	if (ret)
+		return ret;
+	return x->rec < y->rec ? -1 : x->rec > y->rec;
+}
+/* }}} */
+
+/* static dbf_SortSlice() {{{
+ */
+static void dbf_SortSlice(void *ctx, int task, int worker)
+{
+	struct dbf_SortCtx *c = ctx;
+	size_t first = c->nkeys * task / c->nslices;
+	size_t next = c->nkeys * (task + 1) / c->nslices;
+
+	qsort(c->keys + first, next - first, sizeof(struct dbf_SortKey), dbf_SortCompare);
+}
+/* }}} */
+
+/* static dbf_SortNext() {{{
+ * Moves a source to its next record. Returns 1 if there is one, 0 if the
+ * source is exhausted and -1 on error.
+ */
+static int dbf_SortNext(const struct dbf_SortSpec *spec, struct dbf_SortSource *s, u_int32_t reclen)
+{
+	size_t len;
+
+	if (s->keys) {
+		if (s->pos >= s->end)
+			return 0;
+		s->cur = s->keys[s->pos++];
+		return 1;
+	}
+
+	if (s->i >= s->n) {
+		if (s->left == 0)
+			return 0;
+		s->n = s->left < s->bufrecs ? s->left : s->bufrecs;
+		len = (size_t) s->n * reclen;
+		if (dbf_ReadAt(&s->run, s->buf, len, s->offset) != (ssize_t) len)
+			return -1;
+		s->offset += len;
+		s->left -= s->n;
+		s->i = 0;
+	}
+	dbf_SortMakeKey(spec, s->buf + (size_t) s->i++ * reclen, &s->cur);
+
+	return 1;
+}
+/* }}} */
+
+/* static dbf_SortWrite() {{{
+ * Appends a record to the output, which is written in blocks
+ */
+static int dbf_SortWrite(struct dbf_SortWriter *w, const char *rec, u_int32_t reclen)
+{
+	if (w->len + reclen > w->size) {
+		if (dbf_WriteAt(w->out, w->buf, w->len, w->offset) == -1)
+			return -1;
+		w->offset += w->len;
+		w->len = 0;
+	}
+	memcpy(w->buf + w->len, rec, reclen);
+	w->len += reclen;
+	w->count++;
+
+	return 0;
+}
+/* }}} */
+
+/* static dbf_SortMerge() {{{
+ * Merges the sources into the output with a binary heap. Sources with
+ * equal keys are taken in the order of their index.
+ */
+static int dbf_SortMerge(const struct dbf_SortSpec *spec, struct dbf_SortSource *src, int nsrc,
+	struct dbf_SortWriter *w, u_int32_t reclen)
+{
+	struct dbf_SortSource **heap, *s;
+	int n = 0, i, child, ret;
+
+	if (NULL == (heap = malloc((nsrc + 1) * sizeof(struct dbf_SortSource *))))
+		return -1;
+
+	for (i = 0; i < nsrc; i++) {
+		if (0 > (ret = dbf_SortNext(spec, &src[i], reclen)))
+			goto error;
+		if (ret == 0)
+			continue;
+		/* Sift up */
+		child = n++;
+		while (child > 0) {
+			int parent = (child - 1) / 2;
+			int cmp = dbf_SortCompareKeys(spec, &heap[parent]->cur, &src[i].cur);
+
+			if (cmp < 0 || (cmp == 0 && heap[parent]->index < src[i].index))
+				break;
+			heap[child] = heap[parent];
+			child = parent;
+		}
+		heap[child] = &src[i];
+	}
+
+	while (n > 0) {
+		s = heap[0];
+		if (dbf_SortWrite(w, s->cur.rec, reclen) < 0)
+			goto error;
+		if (0 > (ret = dbf_SortNext(spec, s, reclen)))
+			goto error;
+		if (ret == 0)
+			s = heap[--n];
+		/* Sift down */
+		i = 0;
+		while ((child = 2 * i + 1) < n) {
+			int cmp;
+
+			if (child + 1 < n) {
+				cmp = dbf_SortCompareKeys(spec, &heap[child + 1]->cur, &heap[child]->cur);
+				if (cmp < 0 || (cmp == 0 && heap[child + 1]->index < heap[child]->index))
+					child++;
+			}
+			cmp = dbf_SortCompareKeys(spec, &heap[child]->cur, &s->cur);
+			if (cmp > 0 || (cmp == 0 && heap[child]->index > s->index))
+				break;
+			heap[i] = heap[child];
+			i = child;
+		}
+		if (n > 0)
+			heap[i] = s;
+	}
+
+	free(heap);
+	return 0;
+
+error:
+	free(heap);
+	return -1;
+}
+/* }}} */
+
+/* static dbf_SortRun() {{{
+ * Sorts the keys of one run by slices in parallel and merges the slices
+ * into the output
+ */
+static int dbf_SortRun(const struct dbf_SortSpec *spec, struct dbf_SortKey *keys, size_t nkeys,
+	int threads, struct dbf_SortWriter *w, u_int32_t reclen)
+{
+	struct dbf_SortCtx c;
+	struct dbf_SortSource *src;
+	int i, ret;
+
+	c.spec = spec;
+	c.keys = keys;
+	c.nkeys = nkeys;
+	c.nslices = threads;
+	/* Slices of less than a few thousand keys are not worth a thread */
+	if ((size_t) c.nslices > nkeys / 4096 + 1)
+		c.nslices = nkeys / 4096 + 1;
+
+	dbf_RunTasks(c.nslices, c.nslices, dbf_SortSlice, &c);
+
+	if (NULL == (src = calloc(c.nslices, sizeof(struct dbf_SortSource))))
+		return -1;
+	for (i = 0; i < c.nslices; i++) {
+		src[i].keys = keys;
+		src[i].pos = nkeys * i / c.nslices;
+		src[i].end = nkeys * (i + 1) / c.nslices;
+		src[i].index = i;
+	}
+	ret = dbf_SortMerge(spec, src, c.nslices, w, reclen);
+	free(src);
+
+	return ret;
+}
+/* }}} */
+
+/* dbf_Sort() {{{
+ * Writes the records of the table sorted by one column into a new file
+ */
+long dbf_Sort(P_DBF *p_dbf, const char *file, int column, int flags, size_t memory, int threads)
+{
+	u_int32_t reclen = p_dbf->header->record_length;
+	u_int32_t nrecs = p_dbf->header->records;
+	u_int32_t runrecs, recno = 0, filled, i;
+	struct dbf_SortSpec spec;
+	struct dbf_SortWriter w, runw;
+	struct dbf_SortSource *runs = NULL;
+	struct dbf_SortKey *keys = NULL;
+	DB_HEADER header;
+	P_DBF out;
+	const char *records;
+	char *runbuf = NULL, *head = NULL;
+	int nruns = 0, maxruns = 0, fh = -1, n, r;
+	long ret = -1;
+
+	if (column < 0 || column >= (int) p_dbf->columns || NULL == p_dbf->plan || reclen == 0)
+		return -1;
+
+	memset(&spec, 0, sizeof(spec));
+	spec.offset = p_dbf->plan->offset[column];
+	spec.length = p_dbf->plan->length[column];
+	spec.type = p_dbf->plan->type[column];
+	spec.desc = (flags & DBF_SORT_DESC) != 0;
+	/* Character fields are padded with blanks and compare as they are */
+	if (spec.type != DBF_VALUE_STRING)
+		spec.decode = p_dbf->plan->decode[column];
+	if (p_dbf->fields[column].field_type == 'N' && p_dbf->fields[column].field_decimals == 0
+		&& spec.type == DBF_VALUE_DOUBLE)
+		spec.decode = dbf_SortDecodeNumber;
+
+	if (memory == 0)
+		memory = DBF_SORT_MEMORY;
+	runrecs = memory / (reclen + sizeof(struct dbf_SortKey));
+	if (runrecs == 0)
+		runrecs = 1;
+	if (runrecs > nrecs)
+		runrecs = nrecs > 0 ? nrecs : 1;
+	threads = dbf_NumThreads(threads);
+
+	memset(&w, 0, sizeof(w));
+	memset(&runw, 0, sizeof(runw));
+	runbuf = malloc((size_t) runrecs * reclen);
+	keys = malloc((size_t) runrecs * sizeof(struct dbf_SortKey));
+	w.size = DBF_BLOCK_SIZE > reclen ? DBF_BLOCK_SIZE : reclen;
+	w.buf = malloc(w.size);
+	runw.size = w.size;
+	runw.buf = malloc(runw.size);
+	head = malloc(p_dbf->header->header_length);
+	if (!runbuf || !keys || !w.buf || !runw.buf || !head)
+		goto cleanup;
+
+	/* The new table gets the header and field descriptors of the table */
+	if ((fh = open(file, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY, 0644)) == -1)
+		goto cleanup;
+	memset(&out, 0, sizeof(P_DBF));
+	out.dbf_fh = fh;
+	w.out = &out;
+	w.offset = p_dbf->header->header_length;
+	if (dbf_ReadAt(p_dbf, head, p_dbf->header->header_length, 0) != p_dbf->header->header_length ||
+		dbf_WriteAt(&out, head, p_dbf->header->header_length, 0) == -1)
+		goto cleanup;
+
+	while (recno < nrecs) {
+		/* Fill the run with records, leaving out deleted ones */
+		for (filled = 0; filled < runrecs && recno < nrecs; recno += n) {
+			char *dst = runbuf + (size_t) filled * reclen;
+
+			if (0 >= (n = dbf_ReadBlock(p_dbf, recno, runrecs - filled, dst, &records))) {
+				if (n < 0)
+					goto cleanup;
+				nrecs = recno;
+				break;
+			}
+			for (i = 0; i < (u_int32_t) n; i++) {
+				const char *rec = records + (size_t) i * reclen;
+
+				if ((p_dbf->scan_options & DBF_SKIP_DELETED) && rec[0] == '*')
+					continue;
+				if (rec != dst)
+					memmove(dst, rec, reclen);
+				dbf_SortMakeKey(&spec, dst, &keys[filled++]);
+				dst += reclen;
+			}
+		}
+
+		/* A table which fits into memory needs no run files */
+		if (nruns == 0 && recno >= nrecs) {
+			if (dbf_SortRun(&spec, keys, filled, threads, &w, reclen) < 0)
+				goto cleanup;
+			break;
+		}
+
+		if (nruns == maxruns) {
+			struct dbf_SortSource *tmp;
+
+			maxruns = maxruns ? maxruns * 2 : 16;
+			if (NULL == (tmp = realloc(runs, maxruns * sizeof(struct dbf_SortSource))))
+				goto cleanup;
+			runs = tmp;
+		}
+		memset(&runs[nruns], 0, sizeof(struct dbf_SortSource));
+		if (NULL == (runs[nruns].fp = tmpfile()))
+			goto cleanup;
+		runs[nruns].run.dbf_fh = fileno(runs[nruns].fp);
+		runs[nruns].index = nruns;
+		runs[nruns].left = filled;
+		nruns++;
+
+		runw.out = &runs[nruns - 1].run;
+		runw.offset = 0;
+		runw.len = 0;
+		if (dbf_SortRun(&spec, keys, filled, threads, &runw, reclen) < 0)
+			goto cleanup;
+		if (runw.len > 0 && dbf_WriteAt(runw.out, runw.buf, runw.len, runw.offset) == -1)
+			goto cleanup;
+	}
+
+	if (nruns > 0) {
+		/* The memory of the runs is split among the run files */
+		u_int32_t bufrecs = runrecs / nruns;
+
+		if (bufrecs == 0)
+			bufrecs = 1;
+		for (r = 0; r < nruns; r++) {
+			if (NULL == (runs[r].buf = malloc((size_t) bufrecs * reclen)))
+				goto cleanup;
+			runs[r].bufrecs = bufrecs;
+		}
+		free(runbuf);
+		runbuf = NULL;
+		if (dbf_SortMerge(&spec, runs, nruns, &w, reclen) < 0)
+			goto cleanup;
+	}
+
+	if (w.len > 0 && dbf_WriteAt(&out, w.buf, w.len, w.offset) == -1)
+		goto cleanup;
+	if (dbf_WriteAt(&out, "\x1a", 1, w.offset + w.len) == -1)
+		goto cleanup;
+	header = *p_dbf->header;
+	header.records = w.count;
+	if (0 > dbf_WriteHeaderInfo(&out, &header))
+		goto cleanup;
+	ret = w.count;
+
+cleanup:
+	for (r = 0; r < nruns; r++) {
+		if (runs[r].fp)
+			fclose(runs[r].fp);
+		if (runs[r].buf)
+			free(runs[r].buf);
+	}
+	if (runs)
+		free(runs);
+	if (fh != -1 && close(fh) == -1)
+		ret = -1;
+	if (ret < 0 && fh != -1)
+		unlink(file);
+	if (runbuf)
+		free(runbuf);
+	if (keys)
+		free(keys);
+	if (w.buf)
+		free(w.buf);
+	if (runw.buf)
+		free(runw.buf);
+	if (head)
+		free(head);
+
+	return ret;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
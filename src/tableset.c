@@ -0,0 +1,297 @@
+/*****************************************************************************
+ * tableset.c
+ *****************************************************************************
+ * Scans many dBASE files with the same fields as one table
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/*
+ * The files are only opened to compare their fields when the set is
+ * opened. A scan splits all files into chunks of about DBF_BLOCK_SIZE
+ * bytes, which the workers take in the order of the files. Each worker
+ * keeps the file of its current chunk open, so at most one file per
+ * worker is open besides the first file, which stays open to describe
+ * the fields, and no locking is needed. Failures and requests to stop
+ * are shared by atomic flags.
+ */
+
+struct dbf_SetScan {
+	DBF_SET *set;
+	DBF_SCAN callback;
+	void *ctx;
+	/* per chunk: number of the file and first record */
+	int *task_file;
+	u_int32_t *task_first;
+	/* records per chunk */
+	u_int32_t chunkrecs;
+	/* per worker: open file, its number and a buffer of one chunk */
+	P_DBF **handles;
+	int *open_file;
+	char **raw;
+	/* per worker: number of records passed to the callback */
+	long *count;
+	DBF_FLAG failed;
+	DBF_FLAG stop;
+};
+
+/* static dbf_SameFields() {{{
+ * Compares the field descriptors which make up the layout of the records
+ */
+static int dbf_SameFields(P_DBF *a, P_DBF *b)
+{
+	u_int32_t i;
+
+	if (a->columns != b->columns || a->header->record_length != b->header->record_length)
+		return 0;
+	for (i = 0; i < a->columns; i++) {
+		if (strncmp((const char *) a->fields[i].field_name, (const char *) b->fields[i].field_name, 11) != 0 ||
+			a->fields[i].field_type != b->fields[i].field_type ||
+			a->fields[i].field_length != b->fields[i].field_length ||
+			a->fields[i].field_decimals != b->fields[i].field_decimals)
+			return 0;
+	}
+
+	return 1;
+}
+/* }}} */
+
+/* dbf_OpenSet() {{{
+ * Opens a set of files with the same fields
+ */
+DBF_SET *dbf_OpenSet(const char **files, int nfiles, int maxopen)
+{
+	DBF_SET *set;
+	P_DBF *p_dbf;
+	int i;
+
+	if (nfiles <= 0)
+		return NULL;
+	if (NULL == (set = calloc(1, sizeof(DBF_SET))))
+		return NULL;
+	set->maxopen = maxopen;
+	set->files = calloc(nfiles, sizeof(char *));
+	set->records = calloc(nfiles, sizeof(u_int32_t));
+	if (!set->files || !set->records)
+		goto error;
+
+	/* The first file stays open to describe the fields of the set */
+	if (NULL == (set->schema = dbf_Open(files[0])))
+		goto error;
+	for (i = 0; i < nfiles; i++) {
+		if (NULL == (set->files[i] = strdup(files[i])))
+			goto error;
+		set->nfiles++;
+		if (i == 0) {
+			set->records[i] = set->schema->header->records;
+			continue;
+		}
+		if (NULL == (p_dbf = dbf_Open(files[i])))
+			goto error;
+		set->records[i] = p_dbf->header->records;
+		if (!dbf_SameFields(set->schema, p_dbf)) {
+			fprintf(stderr, _("Fields of %s differ from %s.\n"), files[i], files[0]);
+			dbf_Close(p_dbf);
+			goto error;
+		}
+		dbf_Close(p_dbf);
+	}
+
+	return set;
+
+error:
+	dbf_CloseSet(set);
+	return NULL;
+}
+/* }}} */
+
+/* dbf_CloseSet() {{{
+ */
+void dbf_CloseSet(DBF_SET *set)
+{
+	int i;
+
+	if (set->files) {
+		for (i = 0; i < set->nfiles; i++)
+			free(set->files[i]);
+		free(set->files);
+	}
+	if (set->records)
+		free(set->records);
+	if (set->schema)
+		dbf_Close(set->schema);
+	free(set);
+}
+/* }}} */
+
+/* dbf_SetSchema() {{{
+ * Returns the first file of the set to look up the fields
+ */
+P_DBF *dbf_SetSchema(DBF_SET *set)
+{
+	return set->schema;
+}
+/* }}} */
+
+/* dbf_SetNumRows() {{{
+ * Returns the number of records of all files
+ */
+long dbf_SetNumRows(DBF_SET *set)
+{
+	long total = 0;
+	int i;
+
+	for (i = 0; i < set->nfiles; i++)
+		total += set->records[i];
+
+	return total;
+}
+/* }}} */
+
+/* static dbf_SetChunk() {{{
+ * Reads one chunk and passes its records to the callback
+ */
+static void dbf_SetChunk(void *ctx, int task, int worker)
+{
+	struct dbf_SetScan *s = ctx;
+	int file = s->task_file[task];
+	P_DBF *p_dbf;
+	const char *records, *rec;
+	u_int32_t reclen;
+	int n, i;
+
+	if (s->failed || s->stop)
+		return;
+
+	if (s->open_file[worker] != file) {
+		if (s->handles[worker]) {
+			dbf_Close(s->handles[worker]);
+			s->handles[worker] = NULL;
+		}
+		s->open_file[worker] = -1;
+		if (NULL == (s->handles[worker] = dbf_Open(s->set->files[file]))) {
+			s->failed = 1;
+			return;
+		}
+		s->handles[worker]->scan_options = s->set->schema->scan_options;
+		s->open_file[worker] = file;
+	}
+	p_dbf = s->handles[worker];
+	reclen = p_dbf->header->record_length;
+
+	if (0 > (n = dbf_ReadBlock(p_dbf, s->task_first[task], s->chunkrecs, s->raw[worker], &records))) {
+		s->failed = 1;
+		return;
+	}
+	for (i = 0; i < n && !s->stop; i++) {
+		rec = records + i * reclen;
+		if ((p_dbf->scan_options & DBF_SKIP_DELETED) && rec[0] == '*')
+			continue;
+		s->count[worker]++;
+		if (s->callback(s->ctx, file, s->task_first[task] + i, rec, worker))
+			s->stop = 1;
+	}
+}
+/* }}} */
+
+/* dbf_ScanSet() {{{
+ * Passes all records of all files to the callback
+ */
+long dbf_ScanSet(DBF_SET *set, DBF_SCAN callback, void *ctx, int threads)
+{
+	struct dbf_SetScan s;
+	u_int32_t reclen = set->schema->header->record_length;
+	u_int32_t first;
+	long total = 0;
+	int i, ntasks = 0, ret = -1;
+
+	if (reclen == 0)
+		return -1;
+
+	memset(&s, 0, sizeof(s));
+	s.set = set;
+	s.callback = callback;
+	s.ctx = ctx;
+	s.chunkrecs = DBF_BLOCK_SIZE / reclen;
+	if (s.chunkrecs == 0)
+		s.chunkrecs = 1;
+
+	threads = dbf_NumThreads(threads);
+	/* Every worker keeps one file open */
+	if (set->maxopen > 0 && threads > set->maxopen)
+		threads = set->maxopen;
+
+	for (i = 0; i < set->nfiles; i++)
+		ntasks += (set->records[i] + s.chunkrecs - 1) / s.chunkrecs;
+	s.task_file = malloc((ntasks + 1) * sizeof(int));
+	s.task_first = malloc((ntasks + 1) * sizeof(u_int32_t));
+	s.handles = calloc(threads, sizeof(P_DBF *));
+	s.open_file = malloc(threads * sizeof(int));
+	s.raw = calloc(threads, sizeof(char *));
+	s.count = calloc(threads, sizeof(long));
+	if (!s.task_file || !s.task_first || !s.handles || !s.open_file || !s.raw || !s.count)
+		goto cleanup;
+
+	for (ntasks = 0, i = 0; i < set->nfiles; i++) {
+		for (first = 0; first < set->records[i]; first += s.chunkrecs) {
+			s.task_file[ntasks] = i;
+			s.task_first[ntasks] = first;
+			ntasks++;
+		}
+	}
+	for (i = 0; i < threads; i++) {
+		s.open_file[i] = -1;
+		if (NULL == (s.raw[i] = malloc(s.chunkrecs * reclen)))
+			goto cleanup;
+	}
+
+	dbf_RunTasks(threads, ntasks, dbf_SetChunk, &s);
+	if (s.failed)
+		goto cleanup;
+	for (i = 0; i < threads; i++)
+		total += s.count[i];
+	ret = 0;
+
+cleanup:
+	for (i = 0; i < threads; i++) {
+		if (s.handles && s.handles[i])
+			dbf_Close(s.handles[i]);
+		if (s.raw && s.raw[i])
+			free(s.raw[i]);
+	}
+	if (s.task_file)
+		free(s.task_file);
+	if (s.task_first)
+		free(s.task_first);
+	if (s.handles)
+		free(s.handles);
+	if (s.open_file)
+		free(s.open_file);
+	if (s.raw)
+		free(s.raw);
+	if (s.count)
+		free(s.count);
+
+	return ret < 0 ? -1 : total;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
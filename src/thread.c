@@ -0,0 +1,153 @@
+/*****************************************************************************
+ * thread.c
+ *****************************************************************************
+ * Runs tasks of libdbf in parallel
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+/* Workers share DBF_FLAGs, which must be atomic */
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD) && defined(HAVE_STDATOMIC_H)
+#include <pthread.h>
+#define DBF_THREADS 1
+#endif
+
+/* dbf_NumThreads() {{{
+ * Returns the number of threads to use if threads is 0 or less
+ */
+int dbf_NumThreads(int threads)
+{
+#ifdef DBF_THREADS
+	long n;
+
+	if (threads > 0)
+		return threads > DBF_MAX_THREADS ? DBF_MAX_THREADS : threads;
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		return 1;
+	return n > DBF_MAX_THREADS ? DBF_MAX_THREADS : (int) n;
+#else
+	return 1;
+#endif
+}
+/* }}} */
+
+/* dbf_TableThreads() {{{
+ * Returns the number of threads to read a table with. Pipes like stdin
+ * are read by one thread, so that the records arrive in order.
+ */
+int dbf_TableThreads(P_DBF *p_dbf, int threads)
+{
+	if (p_dbf->stream_pos >= 0)
+		return 1;
+
+	return dbf_NumThreads(threads);
+}
+/* }}} */
+
+#ifdef DBF_THREADS
+struct dbf_Tasks {
+	DBF_TASK task;
+	void *ctx;
+	int ntasks;
+	int next;
+	pthread_mutex_t lock;
+};
+
+struct dbf_Worker {
+	struct dbf_Tasks *tasks;
+	int worker;
+};
+
+/* static dbf_RunWorker() {{{
+ * Takes the next task until none are left
+ */
+static void *dbf_RunWorker(void *arg)
+{
+	struct dbf_Worker *w = arg;
+	struct dbf_Tasks *t = w->tasks;
+	int task;
+
+	for (;;) {
+		pthread_mutex_lock(&t->lock);
+		task = t->next++;
+		pthread_mutex_unlock(&t->lock);
+		if (task >= t->ntasks)
+			break;
+		t->task(t->ctx, task, w->worker);
+	}
+
+	return NULL;
+}
+/* }}} */
+#endif
+
+/* dbf_RunTasks() {{{
+ * Calls task for each number 0 .. ntasks-1 and returns when all tasks
+ * have finished. Tasks are taken in ascending order by up to threads
+ * workers, whose number, counted from 0, is passed to the task as well.
+ * Without thread support all tasks are run by the calling thread.
+ */
+int dbf_RunTasks(int threads, int ntasks, DBF_TASK task, void *ctx)
+{
+	int i;
+#ifdef DBF_THREADS
+	pthread_t tid[DBF_MAX_THREADS];
+	struct dbf_Worker workers[DBF_MAX_THREADS];
+	struct dbf_Tasks t;
+	int started;
+
+	threads = dbf_NumThreads(threads);
+	if (threads > ntasks)
+		threads = ntasks;
+	if (threads > 1) {
+		t.task = task;
+		t.ctx = ctx;
+		t.ntasks = ntasks;
+		t.next = 0;
+		pthread_mutex_init(&t.lock, NULL);
+
+		/* The calling thread is worker 0 */
+		for (started = 1; started < threads; started++) {
+			workers[started].tasks = &t;
+			workers[started].worker = started;
+			if (pthread_create(&tid[started], NULL, dbf_RunWorker, &workers[started]) != 0)
+				break;
+		}
+		workers[0].tasks = &t;
+		workers[0].worker = 0;
+		dbf_RunWorker(&workers[0]);
+
+		for (i = 1; i < started; i++)
+			pthread_join(tid[i], NULL);
+		pthread_mutex_destroy(&t.lock);
+		return 0;
+	}
+#endif
+
+	for (i = 0; i < ntasks; i++)
+		task(ctx, i, 0);
+
+	return 0;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */
@@ -0,0 +1,247 @@
+/*****************************************************************************
+ * verify.c
+ *****************************************************************************
+ * Checks dBASE files for truncation and damage
+ *
+ *****************************************************************************
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation. The
+ * author makes no representations about the suitability of this software for
+ * any purpose. It is provided "as is" without express or implied warranty.
+ *
+ * $Id$
+ ****************************************************************************/
+
+#include "../include/libdbf/libdbf.h"
+#include "dbf.h"
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+/*
+ * The table is split into chunks of DBF_BLOCK_SIZE bytes, which are
+ * checksummed by several threads. The checksum of the table is the
+ * CRC32C of the CRC32C values of all chunks, so it does not depend on
+ * the number of threads.
+ */
+
+struct dbf_Verify {
+	P_DBF *p_dbf;
+	/* bytes to check, the header and all records */
+	off_t size;
+	/* per worker buffer of one chunk */
+	char **raw;
+	/* per chunk */
+	u_int32_t *crc;
+	/* set if a chunk could not be read or holds damaged records */
+	DBF_FLAG failed;
+	DBF_FLAG damaged;
+};
+
+#if !defined(__SSE4_2__)
+static u_int32_t dbf_crc32c_table[256];
+#endif
+
+/* static dbf_CRC32CInit() {{{
+ * Computes the table of the reflected polynomial 0x82F63B78
+ */
+static void dbf_CRC32CInit(void)
+{
+#if !defined(__SSE4_2__)
+	u_int32_t c;
+	int i, k;
+
+	if (dbf_crc32c_table[1])
+		return;
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (k = 0; k < 8; k++)
+			c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+		dbf_crc32c_table[i] = c;
+	}
+#endif
+}
+/* }}} */
+
+/* static dbf_CRC32C() {{{
+ */
+static u_int32_t dbf_CRC32C(u_int32_t crc, const unsigned char *buf, size_t len)
+{
+	crc = ~crc;
+#if defined(__SSE4_2__) && defined(__x86_64__)
+	while (len >= 8) {
+		crc = (u_int32_t) _mm_crc32_u64(crc, dbf_Load64(buf));
+		buf += 8;
+		len -= 8;
+	}
+#endif
+	while (len > 0) {
+#if defined(__SSE4_2__)
+		crc = _mm_crc32_u8(crc, *buf++);
+#else
+		crc = dbf_crc32c_table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+#endif
+		len--;
+	}
+
+	return ~crc;
+}
+/* }}} */
+
+/* dbf_CheckSize() {{{
+ * Compares the size of the file with the size stated by the header and
+ * stores both in p_dbf. Returns 0 if the file is complete, 1 if it is
+ * truncated or longer than expected and -1 if the size is unknown.
+ */
+int dbf_CheckSize(P_DBF *p_dbf)
+{
+	struct stat st;
+	off_t size, calc;
+	unsigned char eof;
+
+	if (p_dbf->mem) {
+		size = p_dbf->mem_len;
+	} else {
+		if (fstat(p_dbf->dbf_fh, &st) == -1 || !S_ISREG(st.st_mode))
+			return -1;
+		size = st.st_size;
+	}
+
+	calc = p_dbf->header->header_length + (off_t) p_dbf->header->records * p_dbf->header->record_length;
+	p_dbf->real_filesize = size;
+	p_dbf->calc_filesize = calc;
+
+	/* The records may be followed by the end of file marker 0x1A */
+	if (size == calc ||
+		(size == calc + 1 && dbf_ReadAt(p_dbf, &eof, 1, calc) == 1 && eof == 0x1A)) {
+		memcpy(p_dbf->integrity, "valid", 6);
+		return 0;
+	}
+	memcpy(p_dbf->integrity, "invalid", 7);
+
+	return 1;
+}
+/* }}} */
+
+/* static dbf_VerifyChunk() {{{
+ * Checksums one chunk and checks the deletion flags of the records
+ * starting within it
+ */
+static void dbf_VerifyChunk(void *ctx, int task, int worker)
+{
+	struct dbf_Verify *v = ctx;
+	P_DBF *p_dbf = v->p_dbf;
+	off_t start = (off_t) task * DBF_BLOCK_SIZE;
+	off_t hl = p_dbf->header->header_length;
+	u_int32_t reclen = p_dbf->header->record_length;
+	size_t len = DBF_BLOCK_SIZE;
+	const unsigned char *data;
+	off_t pos;
+
+	if (start + (off_t) len > v->size)
+		len = v->size - start;
+
+	if (p_dbf->mem && NULL == p_dbf->pages) {
+		data = p_dbf->mem + start;
+	} else {
+		if (dbf_ReadAt(p_dbf, v->raw[worker], len, start) != (ssize_t) len) {
+			v->failed = 1;
+			return;
+		}
+		data = (const unsigned char *) v->raw[worker];
+	}
+	v->crc[task] = dbf_CRC32C(0, data, len);
+
+	/* First record starting within the chunk */
+	if (start <= hl)
+		pos = hl;
+	else
+		pos = hl + ((start - hl + reclen - 1) / reclen) * reclen;
+	for (; pos < start + (off_t) len; pos += reclen) {
+		if (data[pos - start] != ' ' && data[pos - start] != '*') {
+			v->damaged = 1;
+			return;
+		}
+	}
+}
+/* }}} */
+
+/* dbf_Verify() {{{
+ * Checks the size of the table and the deletion flags of all records
+ * and computes a checksum of the table
+ */
+int dbf_Verify(P_DBF *p_dbf, u_int32_t *checksum, int threads)
+{
+	struct dbf_Verify v;
+	u_int32_t nchunks, i;
+	int ret, damaged;
+
+	if (p_dbf->header->record_length == 0)
+		return 1;
+	if (0 > (damaged = dbf_CheckSize(p_dbf)))
+		return -1;
+	/* Truncated files are rejected without reading them */
+	if (damaged && p_dbf->real_filesize < p_dbf->calc_filesize)
+		return 1;
+
+	memset(&v, 0, sizeof(v));
+	v.p_dbf = p_dbf;
+	v.size = p_dbf->calc_filesize;
+	nchunks = (v.size + DBF_BLOCK_SIZE - 1) / DBF_BLOCK_SIZE;
+	threads = dbf_TableThreads(p_dbf, threads);
+	dbf_CRC32CInit();
+
+	ret = -1;
+	v.raw = calloc(threads, sizeof(char *));
+	v.crc = calloc(nchunks + 1, sizeof(u_int32_t));
+	if (!v.raw || !v.crc)
+		goto cleanup;
+	for (i = 0; i < (u_int32_t) threads; i++) {
+		if ((NULL == p_dbf->mem || p_dbf->pages) && NULL == (v.raw[i] = malloc(DBF_BLOCK_SIZE)))
+			goto cleanup;
+	}
+
+	dbf_RunTasks(threads, nchunks, dbf_VerifyChunk, &v);
+	if (v.failed)
+		goto cleanup;
+
+	if (checksum) {
+		unsigned char crc[4];
+
+		*checksum = 0;
+		for (i = 0; i < nchunks; i++) {
+			dbf_Store32(crc, v.crc[i]);
+			*checksum = dbf_CRC32C(*checksum, crc, 4);
+		}
+	}
+	if (v.damaged) {
+		memcpy(p_dbf->integrity, "invalid", 7);
+		damaged = 1;
+	}
+	ret = damaged;
+
+cleanup:
+	for (i = 0; v.raw && i < (u_int32_t) threads; i++) {
+		if (v.raw[i])
+			free(v.raw[i]);
+	}
+	if (v.raw)
+		free(v.raw);
+	if (v.crc)
+		free(v.crc);
+
+	return ret;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: sw=4 ts=4 fdm=marker
+ * vim<600: sw=4 ts=4
+ */